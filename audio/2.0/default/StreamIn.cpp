@@ -21,6 +21,8 @@
 #include <android/log.h>
 #include <hardware/audio.h>
 #include <utils/Trace.h>
+#include <string.h>
+#include <algorithm>
 #include <memory>
 
 #include "StreamIn.h"
@@ -53,6 +55,8 @@ class ReadThread : public Thread {
           mEfGroup(efGroup),
           mBuffer(nullptr) {}
     bool init() {
+        // Only used when free space wraps around the end of the queue at
+        // a position which is not frame aligned.
         mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
         return mBuffer != nullptr;
     }
@@ -85,12 +89,41 @@ void ReadThread::doRead() {
             (int32_t)requestedToRead, (int32_t)availableToWrite);
         requestedToRead = availableToWrite;
     }
-    ssize_t readResult = mStream->read(mStream, &mBuffer[0], requestedToRead);
+    StreamIn::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginWrite(requestedToRead, &tx)) {
+        ALOGW("data message queue write failed");
+        mStatus.retval = Result::OK;
+        mStatus.reply.read = 0;
+        return;
+    }
+    // Let the HAL read into the queue memory directly. When the free space
+    // wraps around the end of the queue it is filled with two calls, unless
+    // the split is not frame aligned, then the bounce buffer is used.
+    const auto first = tx.getFirstRegion();
+    const auto second = tx.getSecondRegion();
+    const size_t frameSize = audio_stream_in_frame_size(mStream);
+    ssize_t readResult;
+    if (second.getLength() == 0) {
+        readResult = mStream->read(mStream, first.getAddress(), first.getLength());
+    } else if (frameSize != 0 && first.getLength() % frameSize == 0) {
+        readResult = mStream->read(mStream, first.getAddress(), first.getLength());
+        if (readResult == static_cast<ssize_t>(first.getLength())) {
+            ssize_t secondResult =
+                mStream->read(mStream, second.getAddress(), second.getLength());
+            if (secondResult >= 0) readResult += secondResult;
+        }
+    } else {
+        readResult = mStream->read(mStream, &mBuffer[0], requestedToRead);
+        if (readResult > 0) {
+            size_t inFirst = std::min(static_cast<size_t>(readResult), first.getLength());
+            memcpy(first.getAddress(), &mBuffer[0], inFirst);
+            memcpy(second.getAddress(), &mBuffer[inFirst], readResult - inFirst);
+        }
+    }
     mStatus.retval = Result::OK;
-    uint64_t read = 0;
     if (readResult >= 0) {
         mStatus.reply.read = readResult;
-        if (!mDataMQ->write(&mBuffer[0], readResult)) {
+        if (!mDataMQ->commitWrite(readResult)) {
             ALOGW("data message queue write failed");
         }
     } else {
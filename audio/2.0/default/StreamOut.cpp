@@ -19,6 +19,7 @@
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
 #include <memory>
+#include <string.h>
 
 #include <android/log.h>
 #include <hardware/audio.h>
@@ -52,6 +53,8 @@ class WriteThread : public Thread {
           mEfGroup(efGroup),
           mBuffer(nullptr) {}
     bool init() {
+        // Only used when data wraps around the end of the queue at a position
+        // which is not frame aligned.
         mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
         return mBuffer != nullptr;
     }
@@ -78,13 +81,38 @@ void WriteThread::doWrite() {
     const size_t availToRead = mDataMQ->availableToRead();
     mStatus.retval = Result::OK;
     mStatus.reply.written = 0;
-    if (mDataMQ->read(&mBuffer[0], availToRead)) {
-        ssize_t writeResult = mStream->write(mStream, &mBuffer[0], availToRead);
-        if (writeResult >= 0) {
-            mStatus.reply.written = writeResult;
-        } else {
-            mStatus.retval = Stream::analyzeStatus("write", writeResult);
+    StreamOut::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginRead(availToRead, &tx)) {
+        return;
+    }
+    // Pass the queue memory to the HAL directly. When the data wraps around
+    // the end of the queue it is written with two calls, unless the split
+    // is not frame aligned, then it is gathered into the bounce buffer.
+    const auto first = tx.getFirstRegion();
+    const auto second = tx.getSecondRegion();
+    const size_t frameSize = audio_stream_out_frame_size(mStream);
+    ssize_t writeResult;
+    if (second.getLength() == 0) {
+        writeResult = mStream->write(mStream, first.getAddress(), first.getLength());
+    } else if (frameSize != 0 && first.getLength() % frameSize == 0) {
+        writeResult = mStream->write(mStream, first.getAddress(), first.getLength());
+        if (writeResult == static_cast<ssize_t>(first.getLength())) {
+            ssize_t secondResult =
+                mStream->write(mStream, second.getAddress(), second.getLength());
+            if (secondResult >= 0) writeResult += secondResult;
         }
+    } else {
+        memcpy(&mBuffer[0], first.getAddress(), first.getLength());
+        memcpy(&mBuffer[first.getLength()], second.getAddress(), second.getLength());
+        writeResult = mStream->write(mStream, &mBuffer[0], availToRead);
+    }
+    // All data is consumed regardless of how much the HAL has accepted,
+    // the client resends the remainder.
+    mDataMQ->commitRead(availToRead);
+    if (writeResult >= 0) {
+        mStatus.reply.written = writeResult;
+    } else {
+        mStatus.retval = Stream::analyzeStatus("write", writeResult);
     }
 }
 
@@ -83,6 +83,30 @@ bool AudioBufferWrapper::init() {
     return true;
 }
 
+int AudioBufferSlots::findOrRegister(const AudioBuffer& buffer, int keepSlot) {
+    for (size_t i = 0; i < mSlotCount; ++i) {
+        if (mSlots[i].id == buffer.id) {
+            mSlots[i].wrapper->getHalBuffer()->frameCount = buffer.frameCount;
+            return i;
+        }
+    }
+    sp<AudioBufferWrapper> wrapper;
+    if (!AudioBufferManager::getInstance().wrap(buffer, &wrapper)) return -1;
+    size_t slot;
+    if (mSlotCount < kMaxSlots) {
+        slot = mSlotCount++;
+    } else {
+        if (static_cast<int>(mNextEviction) == keepSlot) {
+            mNextEviction = (mNextEviction + 1) % kMaxSlots;
+        }
+        slot = mNextEviction;
+        mNextEviction = (mNextEviction + 1) % kMaxSlots;
+    }
+    mSlots[slot].id = buffer.id;
+    mSlots[slot].wrapper = wrapper;
+    return slot;
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace effect
@@ -51,6 +51,35 @@ class AudioBufferWrapper : public RefBase {
     audio_buffer_t mHalBuffer;
 };
 
+// Buffers used by an effect session. Clients usually rotate through a few buffers, thus each
+// buffer is wrapped once and then found by its id in a small array of slots, without taking
+// the global lock of AudioBufferManager. Registered buffers stay mapped until they are evicted
+// by newer buffers or the slots are destroyed. Not thread-safe.
+class AudioBufferSlots {
+  public:
+    static constexpr size_t kMaxSlots = 8;
+
+    AudioBufferSlots() : mSlotCount(0), mNextEviction(0) {}
+
+    // Returns the slot index of the buffer, or -1 if it can't be mapped. The buffer in
+    // 'keepSlot' is never evicted.
+    int findOrRegister(const AudioBuffer& buffer, int keepSlot = -1);
+    const sp<AudioBufferWrapper>& get(int slot) const { return mSlots[slot].wrapper; }
+
+  private:
+    AudioBufferSlots(const AudioBufferSlots&) = delete;
+    void operator=(const AudioBufferSlots&) = delete;
+
+    struct Slot {
+        uint64_t id;
+        sp<AudioBufferWrapper> wrapper;
+    };
+
+    Slot mSlots[kMaxSlots];
+    size_t mSlotCount;
+    size_t mNextEviction;
+};
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace effect
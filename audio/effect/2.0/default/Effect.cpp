@@ -399,18 +399,18 @@ Return<void> Effect::prepareForProcessing(prepareForProcessing_cb _hidl_cb) {
 
 Return<Result> Effect::setProcessBuffers(
         const AudioBuffer& inBuffer, const AudioBuffer& outBuffer) {
-    AudioBufferManager& manager = AudioBufferManager::getInstance();
-    sp<AudioBufferWrapper> tempInBuffer, tempOutBuffer;
-    if (!manager.wrap(inBuffer, &tempInBuffer)) {
+    int inSlot = mBufferSlots.findOrRegister(inBuffer);
+    if (inSlot < 0) {
         ALOGE("Could not map memory of the input buffer");
         return Result::INVALID_ARGUMENTS;
     }
-    if (!manager.wrap(outBuffer, &tempOutBuffer)) {
+    int outSlot = mBufferSlots.findOrRegister(outBuffer, inSlot);
+    if (outSlot < 0) {
         ALOGE("Could not map memory of the output buffer");
         return Result::INVALID_ARGUMENTS;
     }
-    mInBuffer = tempInBuffer;
-    mOutBuffer = tempOutBuffer;
+    mInBuffer = mBufferSlots.get(inSlot);
+    mOutBuffer = mBufferSlots.get(outSlot);
     // The processing thread only reads these pointers after waking up by an event flag,
     // so it's OK to update the pair non-atomically.
     mHalInBufferPtr.store(mInBuffer->getHalBuffer(), std::memory_order_release);
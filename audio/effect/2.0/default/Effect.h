@@ -197,6 +197,7 @@ struct Effect : public IEffect {
 
     bool mIsClosed;
     effect_handle_t mHandle;
+    AudioBufferSlots mBufferSlots;
     sp<AudioBufferWrapper> mInBuffer;
     sp<AudioBufferWrapper> mOutBuffer;
     std::atomic<audio_buffer_t*> mHalInBufferPtr;
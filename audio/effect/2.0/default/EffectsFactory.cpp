@@ -53,40 +53,59 @@ namespace effect {
 namespace V2_0 {
 namespace implementation {
 
+namespace {
+
+typedef sp<IEffect> (*EffectCreator)(effect_handle_t handle);
+
+template<typename T> sp<IEffect> createEffectOfType(effect_handle_t handle) {
+    return new T(handle);
+}
+
+typedef std::unordered_map<effect_uuid_t, EffectCreator,
+        EffectsFactory::EffectUuidHash, EffectsFactory::EffectUuidEqual> EffectCreatorMap;
+
+const EffectCreatorMap& getEffectCreators() {
+    // Keyed by effect type UUIDs.
+    static const EffectCreatorMap creators = {
+        { *FX_IID_AEC, &createEffectOfType<AcousticEchoCancelerEffect> },
+        { *FX_IID_AGC, &createEffectOfType<AutomaticGainControlEffect> },
+        { *SL_IID_BASSBOOST, &createEffectOfType<BassBoostEffect> },
+        { *EFFECT_UIID_DOWNMIX, &createEffectOfType<DownmixEffect> },
+        { *SL_IID_ENVIRONMENTALREVERB, &createEffectOfType<EnvironmentalReverbEffect> },
+        { *SL_IID_EQUALIZER, &createEffectOfType<EqualizerEffect> },
+        { *FX_IID_LOUDNESS_ENHANCER, &createEffectOfType<LoudnessEnhancerEffect> },
+        { *FX_IID_NS, &createEffectOfType<NoiseSuppressionEffect> },
+        { *SL_IID_PRESETREVERB, &createEffectOfType<PresetReverbEffect> },
+        { *SL_IID_VIRTUALIZER, &createEffectOfType<VirtualizerEffect> },
+        { *SL_IID_VISUALIZATION, &createEffectOfType<VisualizerEffect> },
+    };
+    return creators;
+}
+
+}  // namespace
+
+size_t EffectsFactory::EffectUuidHash::operator()(const effect_uuid_t& uuid) const {
+    // UUIDs are random enough, mix the two halves.
+    uint64_t words[2];
+    static_assert(sizeof(words) == sizeof(effect_uuid_t), "unexpected effect_uuid_t size");
+    memcpy(words, &uuid, sizeof(words));
+    return std::hash<uint64_t>()(words[0] ^ (words[1] * 0x9e3779b97f4a7c15ULL));
+}
+
 // static
 sp<IEffect> EffectsFactory::dispatchEffectInstanceCreation(
         const effect_descriptor_t& halDescriptor, effect_handle_t handle) {
-    const effect_uuid_t *halUuid = &halDescriptor.type;
-    if (memcmp(halUuid, FX_IID_AEC, sizeof(effect_uuid_t)) == 0) {
-        return new AcousticEchoCancelerEffect(handle);
-    } else if (memcmp(halUuid, FX_IID_AGC, sizeof(effect_uuid_t)) == 0) {
-        return new AutomaticGainControlEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_BASSBOOST, sizeof(effect_uuid_t)) == 0) {
-        return new BassBoostEffect(handle);
-    } else if (memcmp(halUuid, EFFECT_UIID_DOWNMIX, sizeof(effect_uuid_t)) == 0) {
-        return new DownmixEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_ENVIRONMENTALREVERB, sizeof(effect_uuid_t)) == 0) {
-        return new EnvironmentalReverbEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_EQUALIZER, sizeof(effect_uuid_t)) == 0) {
-        return new EqualizerEffect(handle);
-    } else if (memcmp(halUuid, FX_IID_LOUDNESS_ENHANCER, sizeof(effect_uuid_t)) == 0) {
-        return new LoudnessEnhancerEffect(handle);
-    } else if (memcmp(halUuid, FX_IID_NS, sizeof(effect_uuid_t)) == 0) {
-        return new NoiseSuppressionEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_PRESETREVERB, sizeof(effect_uuid_t)) == 0) {
-        return new PresetReverbEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_VIRTUALIZER, sizeof(effect_uuid_t)) == 0) {
-        return new VirtualizerEffect(handle);
-    } else if (memcmp(halUuid, SL_IID_VISUALIZATION, sizeof(effect_uuid_t)) == 0) {
-        return new VisualizerEffect(handle);
+    const EffectCreatorMap& creators = getEffectCreators();
+    auto it = creators.find(halDescriptor.type);
+    if (it != creators.end()) {
+        return it->second(handle);
     }
     return new Effect(handle);
 }
 
-// Methods from ::android::hardware::audio::effect::V2_0::IEffectsFactory follow.
-Return<void> EffectsFactory::getAllDescriptors(getAllDescriptors_cb _hidl_cb)  {
-    Result retval(Result::OK);
-    hidl_vec<EffectDescriptor> result;
+// static
+Result EffectsFactory::queryAllDescriptors(
+        std::vector<effect_descriptor_t>* halDescriptors, uint32_t* queriedNumEffects) {
     uint32_t numEffects;
     status_t status;
 
@@ -94,17 +113,15 @@ restart:
     numEffects = 0;
     status = EffectQueryNumberEffects(&numEffects);
     if (status != OK) {
-        retval = Result::NOT_INITIALIZED;
         ALOGE("Error querying number of effects: %s", strerror(-status));
-        goto exit;
+        halDescriptors->clear();
+        return Result::NOT_INITIALIZED;
     }
-    result.resize(numEffects);
+    *queriedNumEffects = numEffects;
+    halDescriptors->resize(numEffects);
     for (uint32_t i = 0; i < numEffects; ++i) {
-        effect_descriptor_t halDescriptor;
-        status = EffectQueryEffect(i, &halDescriptor);
-        if (status == OK) {
-            effectDescriptorFromHal(halDescriptor, &result[i]);
-        } else {
+        status = EffectQueryEffect(i, &(*halDescriptors)[i]);
+        if (status != OK) {
             ALOGE("Error querying effect at position %d / %d: %s",
                     i, numEffects, strerror(-status));
             switch (status) {
@@ -114,25 +131,75 @@ restart:
                 }
                 case -ENOENT: {
                     // No more effects available.
-                    result.resize(i);
+                    halDescriptors->resize(i);
+                    return Result::OK;
                 }
                 default: {
-                    result.resize(0);
-                    retval = Result::NOT_INITIALIZED;
+                    halDescriptors->clear();
+                    return Result::NOT_INITIALIZED;
                 }
             }
-            break;
         }
     }
+    return Result::OK;
+}
 
-exit:
-    _hidl_cb(retval, result);
+Result EffectsFactory::getDescriptorTable(
+        bool checkForUpdates, std::shared_ptr<const DescriptorTable>* table) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mDescriptorTable && checkForUpdates) {
+        uint32_t numEffects = 0;
+        if (EffectQueryNumberEffects(&numEffects) != OK
+                || numEffects != mDescriptorTable->queriedNumEffects) {
+            mDescriptorTable.reset();
+        }
+    }
+    if (!mDescriptorTable) {
+        std::vector<effect_descriptor_t> halDescriptors;
+        uint32_t queriedNumEffects = 0;
+        Result retval = queryAllDescriptors(&halDescriptors, &queriedNumEffects);
+        if (retval != Result::OK) {
+            table->reset();
+            return retval;
+        }
+        auto newTable = std::make_shared<DescriptorTable>();
+        newTable->queriedNumEffects = queriedNumEffects;
+        newTable->descriptors.resize(halDescriptors.size());
+        newTable->index.reserve(halDescriptors.size());
+        for (size_t i = 0; i < halDescriptors.size(); ++i) {
+            effectDescriptorFromHal(halDescriptors[i], &newTable->descriptors[i]);
+            newTable->index.emplace(halDescriptors[i].uuid, i);
+        }
+        mDescriptorTable = std::move(newTable);
+    }
+    *table = mDescriptorTable;
+    return Result::OK;
+}
+
+// Methods from ::android::hardware::audio::effect::V2_0::IEffectsFactory follow.
+Return<void> EffectsFactory::getAllDescriptors(getAllDescriptors_cb _hidl_cb)  {
+    std::shared_ptr<const DescriptorTable> table;
+    Result retval = getDescriptorTable(true /*checkForUpdates*/, &table);
+    if (retval != Result::OK) {
+        _hidl_cb(retval, hidl_vec<EffectDescriptor>());
+        return Void();
+    }
+    _hidl_cb(retval, table->descriptors);
     return Void();
 }
 
 Return<void> EffectsFactory::getDescriptor(const Uuid& uid, getDescriptor_cb _hidl_cb)  {
     effect_uuid_t halUuid;
     HidlUtils::uuidToHal(uid, &halUuid);
+    std::shared_ptr<const DescriptorTable> table;
+    if (getDescriptorTable(false /*checkForUpdates*/, &table) == Result::OK) {
+        auto it = table->index.find(halUuid);
+        if (it != table->index.end()) {
+            _hidl_cb(Result::OK, table->descriptors[it->second]);
+            return Void();
+        }
+    }
+    // Not known yet, ask the effects library.
     effect_descriptor_t halDescriptor;
     status_t status = EffectGetDescriptor(&halUuid, &halDescriptor);
     EffectDescriptor descriptor;
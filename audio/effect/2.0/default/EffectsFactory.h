@@ -17,6 +17,13 @@
 #ifndef ANDROID_HARDWARE_AUDIO_EFFECT_V2_0_EFFECTSFACTORY_H
 #define ANDROID_HARDWARE_AUDIO_EFFECT_V2_0_EFFECTSFACTORY_H
 
+#include <string.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include <system/audio_effect.h>
 
 #include <android/hardware/audio/effect/2.0/IEffectsFactory.h>
@@ -49,7 +56,32 @@ struct EffectsFactory : public IEffectsFactory {
             const Uuid& uid, int32_t session, int32_t ioHandle, createEffect_cb _hidl_cb)  override;
     Return<void> debugDump(const hidl_handle& fd)  override;
 
+    struct EffectUuidHash {
+        size_t operator()(const effect_uuid_t& uuid) const;
+    };
+    struct EffectUuidEqual {
+        bool operator()(const effect_uuid_t& lhs, const effect_uuid_t& rhs) const {
+            return memcmp(&lhs, &rhs, sizeof(effect_uuid_t)) == 0;
+        }
+    };
+
   private:
+    // Descriptors of all the effects, indexed by their implementation UUIDs. It is built
+    // on first use, and rebuilt by getAllDescriptors when the number of effects reported
+    // by the effects library changes.
+    struct DescriptorTable {
+        // Number of effects reported by the library, may be larger than the number of descriptors.
+        uint32_t queriedNumEffects;
+        hidl_vec<EffectDescriptor> descriptors;
+        std::unordered_map<effect_uuid_t, size_t, EffectUuidHash, EffectUuidEqual> index;
+    };
+
+    std::mutex mLock;
+    std::shared_ptr<const DescriptorTable> mDescriptorTable;
+
+    Result getDescriptorTable(bool checkForUpdates, std::shared_ptr<const DescriptorTable>* table);
+    static Result queryAllDescriptors(
+            std::vector<effect_descriptor_t>* halDescriptors, uint32_t* queriedNumEffects);
     static sp<IEffect> dispatchEffectInstanceCreation(
             const effect_descriptor_t& halDescriptor, effect_handle_t handle);
 };
@@ -18,16 +18,22 @@
 #define android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 
 #include <queue>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <thread>
 #include <condition_variable>
+#include <functional>
 #include <iostream>
+#include <vector>
 
 namespace android {
 
 template<typename T>
 class ConcurrentQueue {
 public:
+    using Clock = std::chrono::steady_clock;
+
     void waitForItems() {
         std::unique_lock<std::mutex> g(mLock);
         while (mQueue.empty() && mIsActive) {
@@ -35,6 +41,21 @@ public:
         }
     }
 
+    /* Waits until the queue has at least minItems items, the given deadline or
+     * the earliest deadline of queued items has passed, or the queue is
+     * deactivated.
+     */
+    void waitForBatch(size_t minItems, Clock::time_point deadline) {
+        std::unique_lock<std::mutex> g(mLock);
+        while (mIsActive && mQueue.size() < minItems) {
+            auto wakeUpTime = std::min(deadline, mEarliestDeadline);
+            if (Clock::now() >= wakeUpTime) {
+                break;
+            }
+            mCond.wait_until(g, wakeUpTime);
+        }
+    }
+
     std::vector<T> flush() {
         std::vector<T> items;
 
@@ -42,24 +63,35 @@ public:
         if (mQueue.empty() || !mIsActive) {
             return items;
         }
+        items.reserve(mQueue.size());
         while (!mQueue.empty()) {
             items.push_back(std::move(mQueue.front()));
             mQueue.pop();
         }
+        mEarliestDeadline = Clock::time_point::max();
         return items;
     }
 
-    void push(T&& item) {
+    /* Pushes an item to the queue. If deliverBy is provided, consumers waiting
+     * in #waitForBatch will be woken up no later than that time.
+     */
+    void push(T&& item, Clock::time_point deliverBy = Clock::time_point::max()) {
         {
             MuxGuard g(mLock);
             if (!mIsActive) {
                 return;
             }
             mQueue.push(std::move(item));
+            mEarliestDeadline = std::min(mEarliestDeadline, deliverBy);
         }
         mCond.notify_one();
     }
 
+    size_t size() const {
+        MuxGuard g(mLock);
+        return mQueue.size();
+    }
+
     /* Deactivates the queue, thus no one can push items to it, also
      * notifies all waiting thread.
      */
@@ -82,6 +114,7 @@ private:
     mutable std::mutex mLock;
     std::condition_variable mCond;
     std::queue<T> mQueue;
+    Clock::time_point mEarliestDeadline = Clock::time_point::max();
 };
 
 template<typename T>
@@ -102,11 +135,18 @@ public:
 
     using OnBatchReceivedFunc = std::function<void(const std::vector<T>& vec)>;
 
+    /* Starts consumer thread. Once the first item arrives, the batch is
+     * delivered when batchInterval elapses, when maxBatchSize items are
+     * collected or when the earliest deliverBy deadline of queued items is
+     * reached, whichever comes first.
+     */
     void run(ConcurrentQueue<T>* queue,
              std::chrono::nanoseconds batchInterval,
-             const OnBatchReceivedFunc& func) {
+             const OnBatchReceivedFunc& func,
+             size_t maxBatchSize = SIZE_MAX) {
         mQueue = queue;
         mBatchInterval = batchInterval;
+        mMaxBatchSize = maxBatchSize;
 
         mWorkerThread = std::thread(
             &BatchingConsumer<T>::runInternal, this, func);
@@ -129,7 +169,9 @@ private:
                 mQueue->waitForItems();
                 if (State::STOP_REQUESTED == mState) break;
 
-                std::this_thread::sleep_for(mBatchInterval);
+                mQueue->waitForBatch(
+                    mMaxBatchSize,
+                    ConcurrentQueue<T>::Clock::now() + mBatchInterval);
                 if (State::STOP_REQUESTED == mState) break;
 
                 std::vector<T> items = mQueue->flush();
@@ -148,6 +190,7 @@ private:
 
     std::atomic<State> mState;
     std::chrono::nanoseconds mBatchInterval;
+    size_t mMaxBatchSize;
     ConcurrentQueue<T>* mQueue;
 };
 
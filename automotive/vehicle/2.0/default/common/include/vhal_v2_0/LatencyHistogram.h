@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_LatencyHistogram_H_
+#define android_hardware_automotive_vehicle_V2_0_LatencyHistogram_H_
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/**
+ * Lock-free histogram of latencies with power of two microsecond buckets:
+ * [0, 1us), [1us, 2us), [2us, 4us), ... and the last bucket collects
+ * everything above.
+ *
+ * Recording is safe from any thread, #dump could be called concurrently but
+ * may observe a sample partially recorded.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t kBucketCount = 24;  // Last bucket starts at ~4s.
+
+    void record(int64_t latencyNanos) {
+        int64_t micros = latencyNanos > 0 ? latencyNanos / 1000 : 0;
+        size_t bucket = 0;
+        while (micros > 0 && bucket < kBucketCount - 1) {
+            micros >>= 1;
+            bucket++;
+        }
+        mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mTotalNanos.fetch_add(latencyNanos, std::memory_order_relaxed);
+
+        int64_t max = mMaxNanos.load(std::memory_order_relaxed);
+        while (latencyNanos > max
+               && !mMaxNanos.compare_exchange_weak(max, latencyNanos,
+                                                   std::memory_order_relaxed)) {}
+    }
+
+    uint64_t getCount() const {
+        return mCount.load(std::memory_order_relaxed);
+    }
+
+    /* Returns human readable representation, one line per non-empty bucket. */
+    std::string dump(const char* prefix = "") const {
+        std::string out;
+        char line[128];
+        uint64_t count = getCount();
+        snprintf(line, sizeof(line), "%scount: %" PRIu64 ", avg: %" PRId64
+                 "us, max: %" PRId64 "us\n", prefix, count,
+                 count > 0 ? mTotalNanos.load() / static_cast<int64_t>(count) / 1000 : 0,
+                 mMaxNanos.load() / 1000);
+        out += line;
+        for (size_t i = 0; i < kBucketCount; i++) {
+            uint64_t n = mBuckets[i].load(std::memory_order_relaxed);
+            if (n == 0) continue;
+            int64_t lowUs = i == 0 ? 0 : (int64_t(1) << (i - 1));
+            if (i == kBucketCount - 1) {
+                snprintf(line, sizeof(line), "%s  >= %" PRId64 "us: %" PRIu64 "\n",
+                         prefix, lowUs, n);
+            } else {
+                snprintf(line, sizeof(line), "%s  [%" PRId64 "us, %" PRId64 "us): %"
+                         PRIu64 "\n", prefix, lowUs, int64_t(1) << i, n);
+            }
+            out += line;
+        }
+        return out;
+    }
+
+private:
+    std::atomic<uint64_t> mBuckets[kBucketCount] {};
+    std::atomic<uint64_t> mCount {0};
+    std::atomic<int64_t> mTotalNanos {0};
+    std::atomic<int64_t> mMaxNanos {0};
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_LatencyHistogram_H_
@@ -17,9 +17,11 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 #define android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <list>
 #include <mutex>
@@ -30,7 +32,17 @@
 
 /**
  * This class allows to specify multiple time intervals to receive
- * notifications. A single thread is used internally.
+ * notifications. A single thread is used internally to track time.
+ *
+ * Events are kept in a min-heap ordered by the absolute time of the next
+ * occurrence, thus registering an event is O(log n) and a wake-up only
+ * touches events that are due. Events due within the coalescing slack are
+ * delivered together with the events that woke up the timer.
+ *
+ * By default the action is invoked on the timer thread. If worker threads are
+ * requested, fired cookies are handed over to a worker pool instead, thus a
+ * slow action doesn't delay the timer. In this case the action could be
+ * called concurrently from different workers.
  */
 class RecurrentTimer {
 private:
@@ -40,7 +52,13 @@ private:
 public:
     using Action = std::function<void(const std::vector<int32_t>& cookies)>;
 
-    RecurrentTimer(const Action& action) : mAction(action) {
+    RecurrentTimer(const Action& action,
+                   Nanos coalescingSlack = Nanos(0),
+                   size_t workerCount = 0)
+            : mAction(action), mCoalescingSlack(coalescingSlack) {
+        for (size_t i = 0; i < workerCount; i++) {
+            mWorkers.push_back(std::thread(&RecurrentTimer::workerLoop, this));
+        }
         mTimerThread = std::thread(&RecurrentTimer::loop, this, action);
     }
 
@@ -61,7 +79,9 @@ public:
 
         {
             std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap[cookie] = { interval, cookie, absoluteTime };
+            uint64_t generation = ++mLastGeneration;
+            mCookieToEventsMap[cookie] = { interval, cookie, absoluteTime, generation };
+            pushEventLocked({ absoluteTime, cookie, generation });
         }
         mCond.notify_one();
     }
@@ -69,6 +89,7 @@ public:
     void unregisterRecurrentEvent(int32_t cookie) {
         {
             std::lock_guard<std::mutex> g(mLock);
+            // Heap entry is left behind and skipped once it reaches the top.
             mCookieToEventsMap.erase(cookie);
         }
         mCond.notify_one();
@@ -81,6 +102,7 @@ private:
         Nanos interval;
         int32_t cookie;
         TimePoint absoluteTime;  // Absolute time of the next event.
+        uint64_t generation;  // Distinguishes heap entries of re-registered events.
 
         void updateNextEventTime(TimePoint now) {
             // We want to move time to next event by adding some number of intervals (usually 1)
@@ -91,10 +113,50 @@ private:
         }
     };
 
+    struct HeapEntry {
+        TimePoint absoluteTime;
+        int32_t cookie;
+        uint64_t generation;
+
+        bool operator>(const HeapEntry& other) const {
+            return absoluteTime > other.absoluteTime;
+        }
+    };
+
+    void pushEventLocked(const HeapEntry& entry) {
+        mEventHeap.push_back(entry);
+        std::push_heap(mEventHeap.begin(), mEventHeap.end(), std::greater<HeapEntry>());
+    }
+
+    void popEventLocked() {
+        std::pop_heap(mEventHeap.begin(), mEventHeap.end(), std::greater<HeapEntry>());
+        mEventHeap.pop_back();
+    }
+
+    /* Returns registered event for given heap entry or nullptr if the entry is stale. */
+    RecurrentEvent* findEventLocked(const HeapEntry& entry) {
+        auto it = mCookieToEventsMap.find(entry.cookie);
+        return (it != mCookieToEventsMap.end() && it->second.generation == entry.generation)
+               ? &it->second : nullptr;
+    }
+
+    void compactHeapLocked() {
+        // Drop stale entries once they dominate the heap.
+        if (mEventHeap.size() <= 2 * mCookieToEventsMap.size() + 16) return;
+
+        mEventHeap.clear();
+        for (auto&& it : mCookieToEventsMap) {
+            const RecurrentEvent& event = it.second;
+            mEventHeap.push_back({ event.absoluteTime, event.cookie, event.generation });
+        }
+        std::make_heap(mEventHeap.begin(), mEventHeap.end(), std::greater<HeapEntry>());
+    }
+
     void loop(const Action& action) {
         static constexpr auto kInvalidTime = TimePoint(Nanos::max());
 
         std::vector<int32_t> cookies;
+        std::vector<HeapEntry> rescheduled;
 
         while (!mStopRequested) {
             auto now = Clock::now();
@@ -104,38 +166,88 @@ private:
             {
                 std::unique_lock<std::mutex> g(mLock);
 
-                for (auto&& it : mCookieToEventsMap) {
-                    RecurrentEvent& event = it.second;
-                    if (event.absoluteTime <= now) {
-                        event.updateNextEventTime(now);
-                        cookies.push_back(event.cookie);
+                compactHeapLocked();
+                while (!mEventHeap.empty()) {
+                    HeapEntry top = mEventHeap.front();
+                    RecurrentEvent* event = findEventLocked(top);
+                    if (event == nullptr) {
+                        popEventLocked();
+                        continue;
                     }
-
-                    if (nextEventTime > event.absoluteTime) {
-                        nextEventTime = event.absoluteTime;
+                    if (top.absoluteTime > now + mCoalescingSlack) {
+                        nextEventTime = top.absoluteTime;
+                        break;
                     }
+                    popEventLocked();
+                    event->updateNextEventTime(now);
+                    cookies.push_back(event->cookie);
+                    // Re-inserted after the scan, thus an event fires at most once per wake-up.
+                    rescheduled.push_back({ event->absoluteTime, event->cookie,
+                                            event->generation });
+                }
+                for (const HeapEntry& entry : rescheduled) {
+                    pushEventLocked(entry);
+                    nextEventTime = std::min(nextEventTime, entry.absoluteTime);
                 }
+                rescheduled.clear();
             }
 
             if (cookies.size() != 0) {
-                action(cookies);
+                if (mWorkers.empty()) {
+                    action(cookies);
+                } else {
+                    {
+                        std::lock_guard<std::mutex> g(mWorkLock);
+                        mPendingWork.push_back(cookies);
+                    }
+                    mWorkCond.notify_one();
+                }
             }
 
             std::unique_lock<std::mutex> g(mLock);
-            mCond.wait_until(g, nextEventTime);  // nextEventTime can be nanoseconds::max()
+            if (!mStopRequested) {
+                mCond.wait_until(g, nextEventTime);  // nextEventTime can be nanoseconds::max()
+            }
+        }
+    }
+
+    void workerLoop() {
+        std::vector<int32_t> cookies;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> g(mWorkLock);
+                while (mPendingWork.empty() && !mStopRequested) {
+                    mWorkCond.wait(g);
+                }
+                if (mPendingWork.empty()) break;  // Stop requested.
+                cookies = std::move(mPendingWork.front());
+                mPendingWork.pop_front();
+            }
+            mAction(cookies);
         }
     }
 
     void stop() {
-        mStopRequested = true;
         {
             std::lock_guard<std::mutex> g(mLock);
+            mStopRequested = true;
             mCookieToEventsMap.clear();
+            mEventHeap.clear();
         }
         mCond.notify_one();
         if (mTimerThread.joinable()) {
             mTimerThread.join();
         }
+
+        {
+            std::lock_guard<std::mutex> g(mWorkLock);
+            mPendingWork.clear();
+        }
+        mWorkCond.notify_all();
+        for (auto& worker : mWorkers) {
+            worker.join();
+        }
+        mWorkers.clear();
     }
 private:
     mutable std::mutex mLock;
@@ -143,7 +255,15 @@ private:
     std::condition_variable mCond;
     std::atomic_bool mStopRequested { false };
     Action mAction;
+    const Nanos mCoalescingSlack;
+    uint64_t mLastGeneration = 0;
     std::unordered_map<int32_t, RecurrentEvent> mCookieToEventsMap;
+    std::vector<HeapEntry> mEventHeap;  // Min-heap by absoluteTime, may have stale entries.
+
+    std::mutex mWorkLock;
+    std::condition_variable mWorkCond;
+    std::deque<std::vector<int32_t>> mPendingWork;
+    std::vector<std::thread> mWorkers;
 };
 
 
@@ -51,6 +51,7 @@ public:
     void addOrUpdateSubscription(const SubscribeOptions &opts);
     bool isSubscribed(int32_t propId, int32_t areaId, SubscribeFlags flags);
     std::vector<int32_t> getSubscribedProperties() const;
+    const SubscribeOptions* getSubscribeOptionsOrNull(int32_t propId) const;
 
 private:
     const sp<IVehicleCallback> mCallback;
@@ -80,6 +81,49 @@ struct HalClientValues {
 
 using ClientId = uint64_t;
 
+/**
+ * Immutable snapshot of subscriptions used to route property values to clients without taking
+ * locks or allocating. It is rebuilt on every subscription change (copy-on-write).
+ */
+struct SubscriptionDispatchTable {
+    struct Entry {
+        uint32_t clientIndex;
+        int32_t vehicleAreas;  // 0 means all areas.
+        SubscribeFlags flags;
+    };
+
+    struct PropertyEntries {
+        int32_t propId;
+        uint32_t begin;  // Range in #entries.
+        uint32_t end;
+    };
+
+    std::vector<sp<HalClient>> clients;
+    std::vector<PropertyEntries> properties;  // Sorted by propId.
+    std::vector<Entry> entries;
+
+    /* Returns nullptr if nobody is subscribed to the property. */
+    const PropertyEntries* findProperty(int32_t propId) const;
+
+    static bool matches(const Entry& entry, int32_t areaId, SubscribeFlags flags) {
+        return (entry.flags & flags)
+               && (entry.vehicleAreas == 0 || areaId == 0 || (entry.vehicleAreas & areaId));
+    }
+};
+
+/**
+ * Reusable output of SubscriptionManager::distributeValuesToClients. Vectors keep their capacity
+ * between batches, thus distributing a batch does not allocate memory in a steady state.
+ */
+struct HalClientValuesBatch {
+    /* Clients at index i receive values[i], clients with no values have empty vectors. */
+    std::shared_ptr<const SubscriptionDispatchTable> table;
+    std::vector<std::vector<VehiclePropValue*>> values;
+
+    size_t size() const { return table ? table->clients.size() : 0; }
+    const sp<HalClient>& clientAt(size_t i) const { return table->clients[i]; }
+};
+
 class SubscriptionManager {
 public:
     using OnPropertyUnsubscribed = std::function<void(int32_t)>;
@@ -115,6 +159,14 @@ public:
             const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
             SubscribeFlags flags) const;
 
+    /**
+     * Same as above, but fills reusable output and doesn't take any locks.
+     */
+    void distributeValuesToClients(
+            const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
+            SubscribeFlags flags,
+            HalClientValuesBatch* outBatch) const;
+
     std::list<sp<HalClient>> getSubscribedClients(int32_t propId,
                                                   int32_t area,
                                                   SubscribeFlags flags) const;
@@ -124,9 +176,8 @@ public:
      */
     void unsubscribe(ClientId clientId, int32_t propId);
 private:
-    std::list<sp<HalClient>> getSubscribedClientsLocked(int32_t propId,
-                                                        int32_t area,
-                                                        SubscribeFlags flags) const;
+    void rebuildDispatchTableLocked();
+    std::shared_ptr<const SubscriptionDispatchTable> getDispatchTable() const;
 
     bool updateHalEventSubscriptionLocked(const SubscribeOptions &opts, SubscribeOptions* out);
 
@@ -168,6 +219,10 @@ private:
     std::map<int32_t, sp<HalClientVector>> mPropToClients;
     std::map<int32_t, SubscribeOptions> mHalEventSubscribeOptions;
 
+    // Accessed with std::atomic_load / std::atomic_store.
+    std::shared_ptr<const SubscriptionDispatchTable> mDispatchTable =
+            std::make_shared<SubscriptionDispatchTable>();
+
     OnPropertyUnsubscribed mOnPropertyUnsubscribed;
     sp<DeathRecipient> mCallbackDeathRecipient;
 };
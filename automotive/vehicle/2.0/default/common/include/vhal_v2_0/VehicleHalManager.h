@@ -21,18 +21,24 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <chrono>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_map>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
 #include "ConcurrentQueue.h"
+#include "LatencyHistogram.h"
 #include "SubscriptionManager.h"
 #include "VehicleHal.h"
 #include "VehicleObjectPool.h"
 #include "VehiclePropConfigIndex.h"
+#include "VehicleUtils.h"
 
 namespace android {
 namespace hardware {
@@ -45,6 +51,9 @@ namespace V2_0 {
  *
  * It has some boilerplate code like batching and caching property values, checking permissions,
  * etc. Vendors must implement VehicleHal class.
+ *
+ * HAL events are batched on a single thread and then handed over to per-client delivery threads,
+ * thus a slow client only delays events for itself.
  */
 class VehicleHalManager : public IVehicle {
 public:
@@ -73,7 +82,53 @@ public:
                                    int32_t propId)  override;
     Return<void> debugDump(debugDump_cb _hidl_cb = nullptr) override;
 
+    /**
+     * Sets for how long events of properties with given change mode could be held in order to
+     * be batched with other events. Batch is delivered as soon as the shortest window of events
+     * in the batch expires or batch reaches its maximum size.
+     */
+    void setEventBatchingWindow(VehiclePropertyChangeMode mode, std::chrono::nanoseconds window);
+
 private:
+    /**
+     * Delivers batches of events to a single client on a dedicated thread. Batches that piled up
+     * while the client was busy are coalesced into a single onPropertyEvent call.
+     */
+    class ClientEventDispatcher {
+    public:
+        ClientEventDispatcher(const sp<HalClient>& client, LatencyHistogram* totalLatency);
+        ~ClientEventDispatcher();
+
+        // Called from BatchingConsumer thread.
+        void dispatch(const sp<HalClient>& client, hidl_vec<VehiclePropValue>&& values);
+        bool isClientAlive() const { return mClient.promote() != nullptr; }
+        bool isDispatcherOf(const sp<HalClient>& client) const {
+            return mClient.promote() == client;
+        }
+        std::string dump() const;
+
+        ClientEventDispatcher(const ClientEventDispatcher&) = delete;
+        ClientEventDispatcher& operator=(const ClientEventDispatcher&) = delete;
+
+    private:
+        struct Batch {
+            sp<HalClient> client;  // Keeps client alive until batch is delivered.
+            hidl_vec<VehiclePropValue> values;
+        };
+
+        void loop();
+
+        const wp<HalClient> mClient;
+        const std::string mName;
+        LatencyHistogram* const mTotalLatency;
+        LatencyHistogram mLatency;  // Event produced -> callback returned.
+        std::atomic<uint64_t> mCallCount {0};
+        std::atomic<uint64_t> mDroppedBatchCount {0};
+        ConcurrentQueue<Batch> mQueue;
+        std::thread mThread;
+    };
+
+
     using VehiclePropValuePtr = VehicleHal::VehiclePropValuePtr;
     // Returns true if needs to call again shortly.
     using RetriableAction = std::function<bool()>;
@@ -90,6 +145,9 @@ private:
 
     void handlePropertySetEvent(const VehiclePropValue& value);
 
+    ClientEventDispatcher* getOrCreateDispatcherLocked(const sp<HalClient>& client);
+    void removeDeadDispatchersLocked();
+
     const VehiclePropConfig* getPropConfigOrNull(int32_t prop) const;
 
     bool checkWritePermission(const VehiclePropConfig &config) const;
@@ -107,11 +165,20 @@ private:
     std::unique_ptr<VehiclePropConfigIndex> mConfigIndex;
     SubscriptionManager mSubscriptionManager;
 
-    hidl_vec<VehiclePropValue> mHidlVecOfVehiclePropValuePool;
+    // Batching windows in nanoseconds indexed by VehiclePropertyChangeMode.
+    std::atomic<int64_t> mBatchingWindowNanos[toInt(VehiclePropertyChangeMode::ON_SET) + 1];
 
     ConcurrentQueue<VehiclePropValuePtr> mEventQueue;
     BatchingConsumer<VehiclePropValuePtr> mBatchingConsumer;
+    HalClientValuesBatch mClientValuesBatch;  // Only used by BatchingConsumer thread.
     VehiclePropValuePool mValueObjectPool;
+
+    LatencyHistogram mBatchingLatency;  // Event produced -> batch handed over to dispatchers.
+    LatencyHistogram mDeliveryLatency;  // Event produced -> callback returned, all clients.
+
+    mutable std::mutex mDispatchersLock;
+    // The address of a dead client may be reused by a new one, see getOrCreateDispatcherLocked.
+    std::unordered_map<HalClient*, std::unique_ptr<ClientEventDispatcher>> mClientDispatchers;
 };
 
 }  // namespace V2_0
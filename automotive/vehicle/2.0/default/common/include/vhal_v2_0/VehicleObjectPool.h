@@ -18,9 +18,8 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_VehicleObjectPool_H_
 #define android_hardware_automotive_vehicle_V2_0_VehicleObjectPool_H_
 
-#include <deque>
-#include <map>
-#include <mutex>
+#include <atomic>
+#include <memory>
 
 #include <android/hardware/automotive/vehicle/2.0/types.h>
 
@@ -45,18 +44,25 @@ struct PoolStats {
 
 template<typename T>
 struct Deleter  {
-    using OnDeleteFunc = std::function<void(T*)>;
+    /**
+     * Plain function pointer rather than std::function: deleters are invoked
+     * for every recycled value and must not add an indirect heap-allocated
+     * functor call on that path.
+     */
+    using OnDeleteFunc = void (*)(T* o, void* cookie);
 
-    Deleter(const OnDeleteFunc& f) : mOnDelete(f) {};
+    Deleter(OnDeleteFunc f, void* cookie = nullptr)
+        : mOnDelete(f), mCookie(cookie) {};
 
     Deleter() = default;
     Deleter(const Deleter&) = default;
 
     void operator()(T* o) {
-        mOnDelete(o);
+        mOnDelete(o, mCookie);
     }
 private:
-    OnDeleteFunc mOnDelete;
+    OnDeleteFunc mOnDelete = nullptr;
+    void* mCookie = nullptr;
 };
 
 /**
@@ -66,33 +72,150 @@ private:
 template <typename T>
 using recyclable_ptr = typename std::unique_ptr<T, Deleter<T>>;
 
+/**
+ * Bounded lock-free LIFO of raw pointers.
+ *
+ * Pointers are stored in a fixed array of nodes. Nodes holding a pointer and
+ * free nodes are linked into two Treiber stacks whose heads pack a node index
+ * together with a modification counter, so a single 64-bit CAS is enough for
+ * push / pop and ABA is not possible. LIFO order also means the most recently
+ * recycled (cache-hot) object is handed out first.
+ *
+ * Objects left in the list are deleted on destruction.
+ */
+template<typename T>
+class LockFreeFreeList {
+public:
+    explicit LockFreeFreeList(size_t capacity)
+        : mCapacity(static_cast<uint32_t>(capacity)),
+          mNodes(new Node[capacity]) {
+        for (uint32_t i = 0; i < mCapacity; i++) {
+            mNodes[i].next.store(i + 1 < mCapacity ? i + 1 : kNil,
+                                 std::memory_order_relaxed);
+            mNodes[i].data = nullptr;
+        }
+        mFreeHead.store(pack(mCapacity > 0 ? 0 : kNil, 0));
+        mUsedHead.store(pack(kNil, 0));
+    }
+
+    ~LockFreeFreeList() {
+        T* o;
+        while ((o = pop()) != nullptr) {
+            delete o;
+        }
+    }
+
+    /** Returns false if the list is full, caller keeps ownership of o. */
+    bool push(T* o) {
+        uint32_t index = popIndex(&mFreeHead);
+        if (index == kNil) {
+            return false;
+        }
+        mNodes[index].data = o;
+        pushIndex(&mUsedHead, index);
+        return true;
+    }
+
+    /** Returns nullptr if the list is empty. */
+    T* pop() {
+        uint32_t index = popIndex(&mUsedHead);
+        if (index == kNil) {
+            return nullptr;
+        }
+        T* o = mNodes[index].data;
+        pushIndex(&mFreeHead, index);
+        return o;
+    }
+
+    size_t capacity() const { return mCapacity; }
+
+    LockFreeFreeList(const LockFreeFreeList&) = delete;
+    LockFreeFreeList& operator=(const LockFreeFreeList&) = delete;
+
+private:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Node {
+        std::atomic<uint32_t> next;
+        T* data;
+    };
+
+    static uint64_t pack(uint32_t index, uint32_t tag) {
+        return (static_cast<uint64_t>(tag) << 32) | index;
+    }
+
+    static uint32_t indexOf(uint64_t head) {
+        return static_cast<uint32_t>(head);
+    }
+
+    static uint32_t tagOf(uint64_t head) {
+        return static_cast<uint32_t>(head >> 32);
+    }
+
+    uint32_t popIndex(std::atomic<uint64_t>* head) {
+        uint64_t h = head->load(std::memory_order_acquire);
+        for (;;) {
+            uint32_t index = indexOf(h);
+            if (index == kNil) {
+                return kNil;
+            }
+            uint32_t next = mNodes[index].next.load(std::memory_order_relaxed);
+            if (head->compare_exchange_weak(h, pack(next, tagOf(h) + 1),
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                return index;
+            }
+        }
+    }
+
+    void pushIndex(std::atomic<uint64_t>* head, uint32_t index) {
+        uint64_t h = head->load(std::memory_order_relaxed);
+        for (;;) {
+            mNodes[index].next.store(indexOf(h), std::memory_order_relaxed);
+            if (head->compare_exchange_weak(h, pack(index, tagOf(h) + 1),
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    static constexpr size_t kCacheLineSize = 64;
+
+    const uint32_t mCapacity;
+    const std::unique_ptr<Node[]> mNodes;
+    alignas(kCacheLineSize) std::atomic<uint64_t> mUsedHead;
+    alignas(kCacheLineSize) std::atomic<uint64_t> mFreeHead;
+};
+
 /**
  * Generic abstract object pool class. Users of this class must implement
  * #createObject method.
  *
- * This class is thread-safe. Concurrent calls to #obtain(...) method from
- * multiple threads is OK, also client can obtain an object in one thread and
- * then move ownership to another thread.
+ * This class is thread-safe and lock-free. Concurrent calls to #obtain(...)
+ * method from multiple threads is OK, also client can obtain an object in one
+ * thread and then move ownership to another thread.
  *
+ * The pool keeps at most #capacity idle objects, objects recycled while the
+ * pool is full are deleted.
  */
 template<typename T>
 class ObjectPool {
 public:
-    ObjectPool() = default;
+    static constexpr size_t kDefaultCapacity = 256;
+
+    explicit ObjectPool(size_t capacity = kDefaultCapacity)
+        : mObjects(capacity) {}
     virtual ~ObjectPool() = default;
 
     virtual recyclable_ptr<T> obtain() {
-        std::lock_guard<std::mutex> g(mLock);
         INC_METRIC_IF_DEBUG(Obtained)
-        if (mObjects.empty()) {
+        T* o = mObjects.pop();
+        if (o == nullptr) {
             INC_METRIC_IF_DEBUG(Created)
-            return wrap(createObject());
+            o = createObject();
         }
-
-        auto o = wrap(mObjects.front().release());
-        mObjects.pop_front();
-
-        return o;
+        return wrap(o);
     }
 
     ObjectPool& operator =(const ObjectPool &) = delete;
@@ -103,28 +226,23 @@ protected:
 
     virtual void recycle(T* o) {
         INC_METRIC_IF_DEBUG(Recycled)
-        std::lock_guard<std::mutex> g(mLock);
-        mObjects.push_back(std::unique_ptr<T> { o } );
+        if (!mObjects.push(o)) {
+            delete o;  // Pool is full.
+        }
     }
 
 private:
-    const Deleter<T>& getDeleter() {
-        if (!mDeleter.get()) {
-            Deleter<T> *d = new Deleter<T>(std::bind(
-                &ObjectPool::recycle, this, std::placeholders::_1));
-            mDeleter.reset(d);
-        }
-        return *mDeleter.get();
+    static void onDelete(T* o, void* cookie) {
+        static_cast<ObjectPool*>(cookie)->recycle(o);
     }
 
     recyclable_ptr<T> wrap(T* raw) {
-        return recyclable_ptr<T> { raw, getDeleter() };
+        return recyclable_ptr<T> { raw, mDeleter };
     }
 
 private:
-    mutable std::mutex mLock;
-    std::deque<std::unique_ptr<T>> mObjects;
-    std::unique_ptr<Deleter<T>> mDeleter;
+    LockFreeFreeList<T> mObjects;
+    const Deleter<T> mDeleter { &ObjectPool::onDelete, this };
 };
 
 /**
@@ -145,7 +263,9 @@ private:
  * pool.
  *
  * This class is thread-safe. Users can obtain an object in one thread and pass
- * it to another.
+ * it to another. Every recyclable (type, vector size) pair has a precomputed
+ * slot, so obtaining a value takes no locks and does no lookups beyond an
+ * array index.
  *
  * Sample usage:
  *
@@ -172,9 +292,14 @@ public:
      * object, but once it goes out of scope it will be deleted immediately, not
      * returning back to the object pool.
      *
+     * @param maxPooledObjectsPerSlot - maximum number of idle objects kept for
+     * every (type, vector size) pair.
+     *
      */
-    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4) :
-        mMaxRecyclableVectorSize(maxRecyclableVectorSize) {};
+    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4,
+                         size_t maxPooledObjectsPerSlot =
+                                 ObjectPool<VehiclePropValue>::kDefaultCapacity);
+    ~VehiclePropValuePool();
 
     RecyclableType obtain(VehiclePropertyType type);
 
@@ -201,10 +326,18 @@ private:
     RecyclableType obtainRecylable(VehiclePropertyType type,
                                    size_t vecSize);
 
+    /**
+     * Returns index of recyclable type in the slot table or -1 if the type is
+     * not recyclable.
+     */
+    static int getTypeIndex(VehiclePropertyType type);
+
     class InternalPool: public ObjectPool<VehiclePropValue> {
     public:
-        InternalPool(VehiclePropertyType type, size_t vectorSize)
-            : mPropType(type), mVectorSize(vectorSize) {}
+        InternalPool(VehiclePropertyType type, size_t vectorSize,
+                     size_t capacity)
+            : ObjectPool<VehiclePropValue>(capacity),
+              mPropType(type), mVectorSize(vectorSize) {}
 
         RecyclableType obtain() {
             return ObjectPool<VehiclePropValue>::obtain();
@@ -225,16 +358,21 @@ private:
     };
 
 private:
+    static void deleteDisposable(VehiclePropValue* v, void* /* cookie */) {
+        delete v;
+    }
+
     const Deleter<VehiclePropValue> mDisposableDeleter {
-        [] (VehiclePropValue* v) {
-            delete v;
-        }
+        &VehiclePropValuePool::deleteDisposable
     };
 
 private:
-    mutable std::mutex mLock;
     const size_t mMaxRecyclableVectorSize;
-    std::map<int32_t, std::unique_ptr<InternalPool>> mValueTypePools;
+    const size_t mMaxPooledObjectsPerSlot;
+    const size_t mSlotCount;
+    // Pools are created lazily, slot index is
+    // getTypeIndex(type) * (mMaxRecyclableVectorSize + 1) + vecSize.
+    std::unique_ptr<std::atomic<InternalPool*>[]> mSlots;
 };
 
 }  // namespace V2_0
@@ -18,12 +18,15 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_PropertyDb_H_
 
 #include <cstdint>
+#include <map>
 #include <unordered_map>
 #include <memory>
 #include <mutex>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
+#include "VehicleObjectPool.h"
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -34,10 +37,16 @@ namespace V2_0 {
  * Encapsulates work related to storing and accessing configuration, storing and modifying
  * vehicle property values.
  *
- * VehiclePropertyValues stored in a sorted map thus it makes easier to get range of values, e.g.
- * to get value for all areas for particular property.
+ * Properties are sharded by property ID. Within a shard, VehiclePropValues stored in a sorted map
+ * thus it makes easier to get range of values, e.g. to get value for all areas for particular
+ * property.
  *
- * This class is thread-safe, however it uses blocking synchronization across all methods.
+ * This class is thread-safe. Every shard publishes immutable snapshots of its configs, its record
+ * map and every stored value (RCU style), so readers never wait for the shard write lock and
+ * writers only serialize with other writers of the same shard. Snapshots are published with
+ * std::atomic_load/atomic_store on shared_ptr, which are not lock-free: they briefly take a
+ * spin lock from a process-wide pool, so readers and writers may still contend on it. Readers
+ * that want to avoid heap allocations could use #readValue or #readPooledValueOrNull.
  */
 class VehiclePropertyStore {
 public:
@@ -59,9 +68,22 @@ private:
         bool operator<(const RecordId& other) const;
     };
 
-    using PropertyMap = std::map<RecordId, VehiclePropValue>;
+    /* Holds latest published value of a record, accessed with std::atomic_load/atomic_store. */
+    struct ValueSlot {
+        std::shared_ptr<const VehiclePropValue> value;
+    };
+
+    using ConfigMap = std::unordered_map<int32_t /* VehicleProperty */,
+                                         std::shared_ptr<const RecordConfig>>;
+    using PropertyMap = std::map<RecordId, std::shared_ptr<ValueSlot>>;
     using PropertyMapRange = std::pair<PropertyMap::const_iterator, PropertyMap::const_iterator>;
 
+    struct Shard {
+        std::mutex writeLock;  // Serializes writers, never taken by readers.
+        std::shared_ptr<const ConfigMap> configs = std::make_shared<ConfigMap>();
+        std::shared_ptr<const PropertyMap> values = std::make_shared<PropertyMap>();
+    };
+
 public:
     void registerProperty(const VehiclePropConfig& config, TokenFunction tokenFunc = nullptr);
 
@@ -78,21 +100,38 @@ public:
     std::unique_ptr<VehiclePropValue> readValueOrNull(int32_t prop, int32_t area = 0,
                                                       int64_t token = 0) const;
 
+    /* Copies stored value into outValue reusing its buffers. No memory is allocated if vectors
+     * in outValue already have the right size. Returns false if there's no such value. */
+    bool readValue(const VehiclePropValue& request, VehiclePropValue* outValue) const;
+    bool readValue(int32_t prop, int32_t area, int64_t token, VehiclePropValue* outValue) const;
+
+    /* Same as readValueOrNull, but the copy is obtained from provided object pool. */
+    VehiclePropValuePool::RecyclableType readPooledValueOrNull(
+            VehiclePropValuePool* pool, const VehiclePropValue& request) const;
+    VehiclePropValuePool::RecyclableType readPooledValueOrNull(
+            VehiclePropValuePool* pool, int32_t prop, int32_t area = 0, int64_t token = 0) const;
+
     std::vector<VehiclePropConfig> getAllConfigs() const;
     const VehiclePropConfig* getConfigOrNull(int32_t propId) const;
     const VehiclePropConfig* getConfigOrDie(int32_t propId) const;
 
 private:
-    RecordId getRecordIdLocked(const VehiclePropValue& valuePrototype) const;
-    const VehiclePropValue* getValueOrNullLocked(const RecordId& recId) const;
-    PropertyMapRange findRangeLocked(int32_t propId) const;
+    static constexpr size_t kShardCount = 16;  // Must match getShardIndex.
 
-private:
-    using MuxGuard = std::lock_guard<std::mutex>;
-    mutable std::mutex mLock;
-    std::unordered_map<int32_t /* VehicleProperty */, RecordConfig> mConfigs;
+    static size_t getShardIndex(int32_t propId);
+    Shard& getShard(int32_t propId);
+    const Shard& getShard(int32_t propId) const;
+
+    static std::shared_ptr<const ConfigMap> loadConfigs(const Shard& shard);
+    static std::shared_ptr<const PropertyMap> loadValues(const Shard& shard);
 
-    PropertyMap mPropertyValues;  // Sorted map of RecordId : VehiclePropValue.
+    RecordId getRecordId(const ConfigMap& configs, const VehiclePropValue& valuePrototype) const;
+    std::shared_ptr<const VehiclePropValue> findValue(const RecordId& recId) const;
+    std::shared_ptr<const VehiclePropValue> findValue(const VehiclePropValue& request) const;
+    static PropertyMapRange findRange(const PropertyMap& values, int32_t propId);
+
+private:
+    Shard mShards[kShardCount];
 };
 
 }  // namespace V2_0
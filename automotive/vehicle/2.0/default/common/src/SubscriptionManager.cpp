@@ -18,6 +18,7 @@
 
 #include "SubscriptionManager.h"
 
+#include <algorithm>
 #include <cmath>
 #include <inttypes.h>
 
@@ -87,6 +88,20 @@ bool HalClient::isSubscribed(int32_t propId,
     return res;
 }
 
+const SubscribeOptions* HalClient::getSubscribeOptionsOrNull(int32_t propId) const {
+    auto it = mSubscriptions.find(propId);
+    return it == mSubscriptions.end() ? nullptr : &it->second;
+}
+
+const SubscriptionDispatchTable::PropertyEntries* SubscriptionDispatchTable::findProperty(
+        int32_t propId) const {
+    auto it = std::lower_bound(properties.begin(), properties.end(), propId,
+                               [](const PropertyEntries& p, int32_t id) {
+                                   return p.propId < id;
+                               });
+    return (it != properties.end() && it->propId == propId) ? &*it : nullptr;
+}
+
 std::vector<int32_t> HalClient::getSubscribedProperties() const {
     std::vector<int32_t> props;
     for (const auto& subscription : mSubscriptions) {
@@ -126,6 +141,7 @@ StatusCode SubscriptionManager::addOrUpdateSubscription(
             }
         }
     }
+    rebuildDispatchTableLocked();
 
     return StatusCode::OK;
 }
@@ -133,52 +149,111 @@ StatusCode SubscriptionManager::addOrUpdateSubscription(
 std::list<HalClientValues> SubscriptionManager::distributeValuesToClients(
         const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
         SubscribeFlags flags) const {
-    std::map<sp<HalClient>, std::list<VehiclePropValue*>> clientValuesMap;
-
-    {
-        MuxGuard g(mLock);
-        for (const auto& propValue: propValues) {
-            VehiclePropValue* v = propValue.get();
-            auto clients = getSubscribedClientsLocked(
-                v->prop, v->areaId, flags);
-            for (const auto& client : clients) {
-                clientValuesMap[client].push_back(v);
-            }
-        }
-    }
+    HalClientValuesBatch batch;
+    distributeValuesToClients(propValues, flags, &batch);
 
     std::list<HalClientValues> clientValues;
-    for (const auto& entry : clientValuesMap) {
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (batch.values[i].empty()) continue;
         clientValues.push_back(HalClientValues {
-            .client = entry.first,
-            .values = entry.second
+            .client = batch.clientAt(i),
+            .values = std::list<VehiclePropValue*>(batch.values[i].begin(),
+                                                   batch.values[i].end())
         });
     }
 
     return clientValues;
 }
 
+void SubscriptionManager::distributeValuesToClients(
+        const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
+        SubscribeFlags flags,
+        HalClientValuesBatch* outBatch) const {
+    outBatch->table = getDispatchTable();
+    const SubscriptionDispatchTable& table = *outBatch->table;
+
+    if (outBatch->values.size() < table.clients.size()) {
+        outBatch->values.resize(table.clients.size());
+    }
+    for (auto& values : outBatch->values) {
+        values.clear();
+    }
+
+    for (const auto& propValue: propValues) {
+        VehiclePropValue* v = propValue.get();
+        const auto* prop = table.findProperty(v->prop);
+        if (prop == nullptr) continue;
+
+        for (uint32_t i = prop->begin; i < prop->end; i++) {
+            const auto& entry = table.entries[i];
+            if (SubscriptionDispatchTable::matches(entry, v->areaId, flags)) {
+                outBatch->values[entry.clientIndex].push_back(v);
+            }
+        }
+    }
+}
+
 std::list<sp<HalClient>> SubscriptionManager::getSubscribedClients(
     int32_t propId, int32_t area, SubscribeFlags flags) const {
-    MuxGuard g(mLock);
-    return getSubscribedClientsLocked(propId, area, flags);
+    std::list<sp<HalClient>> subscribedClients;
+
+    auto table = getDispatchTable();
+    const auto* prop = table->findProperty(propId);
+    if (prop != nullptr) {
+        for (uint32_t i = prop->begin; i < prop->end; i++) {
+            const auto& entry = table->entries[i];
+            if (SubscriptionDispatchTable::matches(entry, area, flags)) {
+                subscribedClients.push_back(table->clients[entry.clientIndex]);
+            }
+        }
+    }
+
+    return subscribedClients;
 }
 
-std::list<sp<HalClient>> SubscriptionManager::getSubscribedClientsLocked(
-        int32_t propId, int32_t area, SubscribeFlags flags) const {
-    std::list<sp<HalClient>> subscribedClients;
+void SubscriptionManager::rebuildDispatchTableLocked() {
+    auto table = std::make_shared<SubscriptionDispatchTable>();
+
+    std::map<HalClient*, uint32_t> clientIndexes;
+    for (const auto& it : mClients) {
+        clientIndexes.emplace(it.second.get(), table->clients.size());
+        table->clients.push_back(it.second);
+    }
 
-    sp<HalClientVector> propClients = getClientsForPropertyLocked(propId);
-    if (propClients.get() != nullptr) {
+    // mPropToClients is sorted by property ID, thus properties will be sorted as well.
+    for (const auto& it : mPropToClients) {
+        int32_t propId = it.first;
+        const sp<HalClientVector>& propClients = it.second;
+
+        SubscriptionDispatchTable::PropertyEntries prop {
+            .propId = propId,
+            .begin = static_cast<uint32_t>(table->entries.size()),
+            .end = 0,
+        };
         for (size_t i = 0; i < propClients->size(); i++) {
             const auto& client = propClients->itemAt(i);
-            if (client->isSubscribed(propId, area, flags)) {
-                subscribedClients.push_back(client);
-            }
+            const SubscribeOptions* opts = client->getSubscribeOptionsOrNull(propId);
+            auto clientIndexIt = clientIndexes.find(client.get());
+            if (opts == nullptr || clientIndexIt == clientIndexes.end()) continue;
+
+            table->entries.push_back(SubscriptionDispatchTable::Entry {
+                .clientIndex = clientIndexIt->second,
+                .vehicleAreas = opts->vehicleAreas,
+                .flags = opts->flags,
+            });
+        }
+        prop.end = static_cast<uint32_t>(table->entries.size());
+        if (prop.end > prop.begin) {
+            table->properties.push_back(prop);
         }
     }
 
-    return subscribedClients;
+    std::atomic_store(&mDispatchTable,
+                      std::shared_ptr<const SubscriptionDispatchTable>(std::move(table)));
+}
+
+std::shared_ptr<const SubscriptionDispatchTable> SubscriptionManager::getDispatchTable() const {
+    return std::atomic_load(&mDispatchTable);
 }
 
 bool SubscriptionManager::updateHalEventSubscriptionLocked(
@@ -279,6 +354,8 @@ void SubscriptionManager::unsubscribe(ClientId clientId,
         }
     }
 
+    rebuildDispatchTableLocked();
+
     if (propertyClients == nullptr || propertyClients->isEmpty()) {
         mHalEventSubscribeOptions.erase(propId);
         mOnPropertyUnsubscribed(propId);
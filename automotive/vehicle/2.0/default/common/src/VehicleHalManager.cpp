@@ -23,6 +23,7 @@
 
 #include <android/log.h>
 #include <android/hardware/automotive/vehicle/2.0/BpHwVehicleCallback.h>
+#include <utils/SystemClock.h>
 
 #include "VehicleUtils.h"
 
@@ -34,15 +35,25 @@ namespace V2_0 {
 
 using namespace std::placeholders;
 
+/**
+ * Default batching windows. On-change events are rare and latency sensitive, continuous events
+ * are frequent and benefit from being delivered together.
+ */
 constexpr std::chrono::milliseconds kHalEventBatchingTimeWindow(10);
+constexpr std::chrono::milliseconds kOnChangeHalEventBatchingTimeWindow(1);
 
-const VehiclePropValue kEmptyValue{};
+/**
+ * Batch is delivered immediately once it has this many events.
+ */
+constexpr size_t kHalEventMaxBatchSize = 64;
 
 /**
- * Indicates what's the maximum size of hidl_vec<VehiclePropValue> we want
- * to store in reusable object pool.
+ * Maximum number of batches that could be waiting for delivery to a single client, newer batches
+ * are dropped once this limit is reached.
  */
-constexpr auto kMaxHidlVecOfVehiclPropValuePoolSize = 20;
+constexpr size_t kMaxPendingClientBatches = 256;
+
+const VehiclePropValue kEmptyValue{};
 
 Return<void> VehicleHalManager::getAllPropConfigs(getAllPropConfigs_cb _hidl_cb) {
     ALOGI("getAllPropConfigs called");
@@ -177,20 +188,43 @@ Return<StatusCode> VehicleHalManager::unsubscribe(const sp<IVehicleCallback>& ca
 }
 
 Return<void> VehicleHalManager::debugDump(IVehicle::debugDump_cb _hidl_cb) {
-    _hidl_cb("");
+    std::string dump;
+    dump += "HAL event batching latency:\n" + mBatchingLatency.dump("  ");
+    dump += "HAL event delivery latency, all clients:\n" + mDeliveryLatency.dump("  ");
+    {
+        std::lock_guard<std::mutex> g(mDispatchersLock);
+        for (const auto& it : mClientDispatchers) {
+            dump += it.second->dump();
+        }
+    }
+    _hidl_cb(dump);
     return Void();
 }
 
+void VehicleHalManager::setEventBatchingWindow(VehiclePropertyChangeMode mode,
+                                               std::chrono::nanoseconds window) {
+    int32_t index = toInt(mode);
+    if (index < 0 || index > toInt(VehiclePropertyChangeMode::ON_SET)) {
+        ALOGE("%s: unknown change mode: %d", __func__, index);
+        return;
+    }
+    mBatchingWindowNanos[index] = window.count();
+}
+
 void VehicleHalManager::init() {
     ALOGI("VehicleHalManager::init");
 
-    mHidlVecOfVehiclePropValuePool.resize(kMaxHidlVecOfVehiclPropValuePoolSize);
-
+    for (auto& window : mBatchingWindowNanos) {
+        window = std::chrono::nanoseconds(kHalEventBatchingTimeWindow).count();
+    }
+    setEventBatchingWindow(VehiclePropertyChangeMode::ON_CHANGE,
+                           kOnChangeHalEventBatchingTimeWindow);
 
     mBatchingConsumer.run(&mEventQueue,
                           kHalEventBatchingTimeWindow,
                           std::bind(&VehicleHalManager::onBatchHalEvent,
-                                    this, _1));
+                                    this, _1),
+                          kHalEventMaxBatchSize);
 
     mHal->init(&mValueObjectPool,
                std::bind(&VehicleHalManager::onHalEvent, this, _1),
@@ -214,11 +248,26 @@ VehicleHalManager::~VehicleHalManager() {
     // We have to wait until consumer thread is fully stopped because it may
     // be in a state of running callback (onBatchHalEvent).
     mBatchingConsumer.waitStopped();
+    {
+        std::lock_guard<std::mutex> g(mDispatchersLock);
+        // Drops the batches that were not delivered yet and waits for the callbacks in progress.
+        mClientDispatchers.clear();
+    }
     ALOGI("VehicleHalManager::dtor");
 }
 
 void VehicleHalManager::onHalEvent(VehiclePropValuePtr v) {
-    mEventQueue.push(std::move(v));
+    auto window = std::chrono::nanoseconds(kHalEventBatchingTimeWindow).count();
+    const auto* config = mConfigIndex ? getPropConfigOrNull(v->prop) : nullptr;
+    if (config != nullptr) {
+        int32_t mode = toInt(config->changeMode);
+        if (mode >= 0 && mode <= toInt(VehiclePropertyChangeMode::ON_SET)) {
+            window = mBatchingWindowNanos[mode];
+        }
+    }
+    mEventQueue.push(std::move(v),
+                     ConcurrentQueue<VehiclePropValuePtr>::Clock::now()
+                     + std::chrono::nanoseconds(window));
 }
 
 void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
@@ -233,31 +282,132 @@ void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
 }
 
 void VehicleHalManager::onBatchHalEvent(const std::vector<VehiclePropValuePtr>& values) {
-    const auto& clientValues = mSubscriptionManager.distributeValuesToClients(
-            values, SubscribeFlags::HAL_EVENT);
+    int64_t now = elapsedRealtimeNano();
+    for (const auto& v : values) {
+        mBatchingLatency.record(now - v->timestamp);
+    }
 
-    for (const HalClientValues& cv : clientValues) {
-        auto vecSize = cv.values.size();
+    mSubscriptionManager.distributeValuesToClients(values, SubscribeFlags::HAL_EVENT,
+                                                   &mClientValuesBatch);
+
+    std::lock_guard<std::mutex> g(mDispatchersLock);
+    for (size_t c = 0; c < mClientValuesBatch.size(); c++) {
+        const auto& clientValues = mClientValuesBatch.values[c];
+        if (clientValues.empty()) continue;
+
+        // Values are owned by this batch, thus they have to be copied before handing them over
+        // to the client's delivery thread.
         hidl_vec<VehiclePropValue> vec;
-        if (vecSize < kMaxHidlVecOfVehiclPropValuePoolSize) {
-            vec.setToExternal(&mHidlVecOfVehiclePropValuePool[0], vecSize);
+        vec.resize(clientValues.size());
+        for (size_t i = 0; i < clientValues.size(); i++) {
+            vec[i] = *clientValues[i];
+        }
+        const sp<HalClient>& client = mClientValuesBatch.clientAt(c);
+        getOrCreateDispatcherLocked(client)->dispatch(client, std::move(vec));
+    }
+    mClientValuesBatch.table.reset();  // Don't keep clients alive until the next batch.
+    removeDeadDispatchersLocked();
+}
+
+VehicleHalManager::ClientEventDispatcher* VehicleHalManager::getOrCreateDispatcherLocked(
+        const sp<HalClient>& client) {
+    auto it = mClientDispatchers.find(client.get());
+    if (it != mClientDispatchers.end() && !it->second->isDispatcherOf(client)) {
+        // A dead client's dispatcher that wasn't removed yet, and the new client got its address.
+        mClientDispatchers.erase(it);
+        it = mClientDispatchers.end();
+    }
+    if (it == mClientDispatchers.end()) {
+        it = mClientDispatchers.emplace(
+                client.get(),
+                std::make_unique<ClientEventDispatcher>(client, &mDeliveryLatency)).first;
+    }
+    return it->second.get();
+}
+
+void VehicleHalManager::removeDeadDispatchersLocked() {
+    // Pending batches hold strong references to the client, thus dispatchers of dead clients
+    // have nothing left to deliver.
+    for (auto it = mClientDispatchers.begin(); it != mClientDispatchers.end();) {
+        if (it->second->isClientAlive()) {
+            ++it;
         } else {
-            vec.resize(vecSize);
+            it = mClientDispatchers.erase(it);
+        }
+    }
+}
+
+VehicleHalManager::ClientEventDispatcher::ClientEventDispatcher(const sp<HalClient>& client,
+                                                                LatencyHistogram* totalLatency)
+    : mClient(client),
+      mName(toString(client->getCallback())),
+      mTotalLatency(totalLatency) {
+    mThread = std::thread(&ClientEventDispatcher::loop, this);
+}
+
+VehicleHalManager::ClientEventDispatcher::~ClientEventDispatcher() {
+    mQueue.deactivate();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void VehicleHalManager::ClientEventDispatcher::dispatch(const sp<HalClient>& client,
+                                                        hidl_vec<VehiclePropValue>&& values) {
+    if (mQueue.size() >= kMaxPendingClientBatches) {
+        if (mDroppedBatchCount++ == 0) {
+            ALOGW("Client %s is too slow, dropping events", mName.c_str());
+        }
+        return;
+    }
+    mQueue.push(Batch { client, std::move(values) });
+}
+
+void VehicleHalManager::ClientEventDispatcher::loop() {
+    for (;;) {
+        mQueue.waitForItems();
+        std::vector<Batch> batches = mQueue.flush();
+        if (batches.empty()) {
+            break;  // Queue was deactivated.
         }
 
-        int i = 0;
-        for (VehiclePropValue* pValue : cv.values) {
-            shallowCopy(&(vec)[i++], *pValue);
+        hidl_vec<VehiclePropValue> vec;
+        if (batches.size() == 1) {
+            vec = std::move(batches.front().values);
+        } else {
+            size_t total = 0;
+            for (const auto& b : batches) total += b.values.size();
+            vec.resize(total);
+            size_t i = 0;
+            for (auto& b : batches) {
+                for (size_t j = 0; j < b.values.size(); j++) {
+                    vec[i++] = std::move(b.values[j]);
+                }
+            }
         }
-        auto status = cv.client->getCallback()->onPropertyEvent(vec);
+
+        auto status = batches.front().client->getCallback()->onPropertyEvent(vec);
         if (!status.isOk()) {
-            ALOGE("Failed to notify client %s, err: %s",
-                  toString(cv.client->getCallback()).c_str(),
+            ALOGE("Failed to notify client %s, err: %s", mName.c_str(),
                   status.description().c_str());
         }
+        mCallCount++;
+
+        int64_t now = elapsedRealtimeNano();
+        for (size_t i = 0; i < vec.size(); i++) {
+            mLatency.record(now - vec[i].timestamp);
+            mTotalLatency->record(now - vec[i].timestamp);
+        }
     }
 }
 
+std::string VehicleHalManager::ClientEventDispatcher::dump() const {
+    return "Client " + mName + ", callbacks: " + std::to_string(mCallCount.load())
+            + ", dropped batches: " + std::to_string(mDroppedBatchCount.load())
+            + ", pending batches: " + std::to_string(mQueue.size()) + "\n"
+            + mLatency.dump("  ");
+}
+
 bool VehicleHalManager::isSampleRateFixed(VehiclePropertyChangeMode mode) {
     return (mode & VehiclePropertyChangeMode::ON_SET)
            || (mode & VehiclePropertyChangeMode::ON_CHANGE);
@@ -28,6 +28,50 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+namespace {
+
+// Property types which values could be stored in the pool.
+constexpr VehiclePropertyType kRecyclableTypes[] = {
+    VehiclePropertyType::BOOLEAN,
+    VehiclePropertyType::INT32,
+    VehiclePropertyType::INT32_VEC,
+    VehiclePropertyType::INT64,
+    VehiclePropertyType::FLOAT,
+    VehiclePropertyType::FLOAT_VEC,
+    VehiclePropertyType::BYTES,
+};
+
+constexpr size_t kRecyclableTypeCount =
+        sizeof(kRecyclableTypes) / sizeof(kRecyclableTypes[0]);
+
+}  // namespace anonymous
+
+VehiclePropValuePool::VehiclePropValuePool(size_t maxRecyclableVectorSize,
+                                           size_t maxPooledObjectsPerSlot)
+    : mMaxRecyclableVectorSize(maxRecyclableVectorSize),
+      mMaxPooledObjectsPerSlot(maxPooledObjectsPerSlot),
+      mSlotCount(kRecyclableTypeCount * (maxRecyclableVectorSize + 1)),
+      mSlots(new std::atomic<InternalPool*>[mSlotCount]) {
+    for (size_t i = 0; i < mSlotCount; i++) {
+        mSlots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+VehiclePropValuePool::~VehiclePropValuePool() {
+    for (size_t i = 0; i < mSlotCount; i++) {
+        delete mSlots[i].load(std::memory_order_acquire);
+    }
+}
+
+int VehiclePropValuePool::getTypeIndex(VehiclePropertyType type) {
+    for (size_t i = 0; i < kRecyclableTypeCount; i++) {
+        if (kRecyclableTypes[i] == type) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(
         VehiclePropertyType type, size_t vecSize) {
     return isDisposable(type, vecSize)
@@ -87,18 +131,24 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainComplex() {
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainRecylable(
         VehiclePropertyType type, size_t vecSize) {
-    // VehiclePropertyType is not overlapping with vectorSize.
-    int32_t key = static_cast<int32_t>(type)
-                  | static_cast<int32_t>(vecSize);
-
-    std::lock_guard<std::mutex> g(mLock);
-    auto it = mValueTypePools.find(key);
-
-    if (it == mValueTypePools.end()) {
-        auto newPool(std::make_unique<InternalPool>(type, vecSize));
-        it = mValueTypePools.emplace(key, std::move(newPool)).first;
+    int typeIndex = getTypeIndex(type);
+    if (typeIndex < 0) {
+        ALOGE("Unable to obtain recyclable value of unknown type: 0x%x",
+              toInt(type));
+        return obtainDisposable(type, vecSize);
+    }
+    auto& slot = mSlots[typeIndex * (mMaxRecyclableVectorSize + 1) + vecSize];
+
+    InternalPool* pool = slot.load(std::memory_order_acquire);
+    if (pool == nullptr) {
+        auto newPool = std::make_unique<InternalPool>(
+                type, vecSize, mMaxPooledObjectsPerSlot);
+        if (slot.compare_exchange_strong(pool, newPool.get(),
+                                         std::memory_order_acq_rel)) {
+            pool = newPool.release();
+        }  // Otherwise another thread won, pool now points to its instance.
     }
-    return it->second->obtain();
+    return pool->obtain();
 }
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainBoolean(
@@ -25,6 +25,20 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+namespace {
+
+bool copyValue(const VehiclePropValue* src, VehiclePropValue* dest) {
+    if (src == nullptr) return false;
+
+    dest->prop = src->prop;
+    dest->areaId = src->areaId;
+    dest->timestamp = src->timestamp;
+    copyVehicleRawValue(&dest->value, src->value);
+    return true;
+}
+
+}  // namespace
+
 bool VehiclePropertyStore::RecordId::operator==(const VehiclePropertyStore::RecordId& other) const {
     return prop == other.prop && area == other.area && token == other.token;
 }
@@ -37,56 +51,82 @@ bool VehiclePropertyStore::RecordId::operator<(const VehiclePropertyStore::Recor
 
 void VehiclePropertyStore::registerProperty(const VehiclePropConfig& config,
                                             VehiclePropertyStore::TokenFunction tokenFunc) {
-    MuxGuard g(mLock);
-    mConfigs.insert({ config.prop, RecordConfig { config, tokenFunc } });
+    Shard& shard = getShard(config.prop);
+    std::lock_guard<std::mutex> g(shard.writeLock);
+    auto configs = std::make_shared<ConfigMap>(*loadConfigs(shard));
+    configs->insert({ config.prop,
+                      std::make_shared<const RecordConfig>(RecordConfig { config, tokenFunc }) });
+    std::atomic_store(&shard.configs, std::shared_ptr<const ConfigMap>(std::move(configs)));
 }
 
 bool VehiclePropertyStore::writeValue(const VehiclePropValue& propValue) {
-    MuxGuard g(mLock);
-    if (!mConfigs.count(propValue.prop)) return false;
+    Shard& shard = getShard(propValue.prop);
+    std::lock_guard<std::mutex> g(shard.writeLock);
+    auto configs = loadConfigs(shard);
+    if (!configs->count(propValue.prop)) return false;
 
-    RecordId recId = getRecordIdLocked(propValue);
-    VehiclePropValue* valueToUpdate = const_cast<VehiclePropValue*>(getValueOrNullLocked(recId));
-    if (valueToUpdate == nullptr) {
-        mPropertyValues.insert({ recId, propValue });
+    RecordId recId = getRecordId(*configs, propValue);
+
+    auto values = loadValues(shard);
+    auto it = values->find(recId);
+    if (it != values->end()) {
+        // Existing record, only timestamp and value are updated in a new snapshot.
+        auto value = std::make_shared<VehiclePropValue>(*std::atomic_load(&it->second->value));
+        value->timestamp = propValue.timestamp;
+        value->value = propValue.value;
+        std::atomic_store(&it->second->value,
+                          std::shared_ptr<const VehiclePropValue>(std::move(value)));
     } else {
-        valueToUpdate->timestamp = propValue.timestamp;
-        valueToUpdate->value = propValue.value;
+        auto newValues = std::make_shared<PropertyMap>(*values);
+        auto slot = std::make_shared<ValueSlot>();
+        slot->value = std::make_shared<const VehiclePropValue>(propValue);
+        newValues->insert({ recId, std::move(slot) });
+        std::atomic_store(&shard.values, std::shared_ptr<const PropertyMap>(std::move(newValues)));
     }
     return true;
 }
 
 void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
-    MuxGuard g(mLock);
-    RecordId recId = getRecordIdLocked(propValue);
-    auto it = mPropertyValues.find(recId);
-    if (it != mPropertyValues.end()) {
-        mPropertyValues.erase(it);
+    Shard& shard = getShard(propValue.prop);
+    std::lock_guard<std::mutex> g(shard.writeLock);
+    RecordId recId = getRecordId(*loadConfigs(shard), propValue);
+    auto values = loadValues(shard);
+    if (values->count(recId)) {
+        auto newValues = std::make_shared<PropertyMap>(*values);
+        newValues->erase(recId);
+        std::atomic_store(&shard.values, std::shared_ptr<const PropertyMap>(std::move(newValues)));
     }
 }
 
 void VehiclePropertyStore::removeValuesForProperty(int32_t propId) {
-    MuxGuard g(mLock);
-    auto range = findRangeLocked(propId);
-    mPropertyValues.erase(range.first, range.second);
+    Shard& shard = getShard(propId);
+    std::lock_guard<std::mutex> g(shard.writeLock);
+    auto values = loadValues(shard);
+    auto range = findRange(*values, propId);
+    if (range.first != range.second) {
+        auto newValues = std::make_shared<PropertyMap>(values->begin(), range.first);
+        newValues->insert(range.second, values->end());
+        std::atomic_store(&shard.values, std::shared_ptr<const PropertyMap>(std::move(newValues)));
+    }
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readAllValues() const {
-    MuxGuard g(mLock);
     std::vector<VehiclePropValue> allValues;
-    allValues.reserve(mPropertyValues.size());
-    for (auto&& it : mPropertyValues) {
-        allValues.push_back(it.second);
+    for (const Shard& shard : mShards) {
+        auto values = loadValues(shard);
+        for (auto&& it : *values) {
+            allValues.push_back(*std::atomic_load(&it.second->value));
+        }
     }
     return allValues;
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_t propId) const {
     std::vector<VehiclePropValue> values;
-    MuxGuard g(mLock);
-    auto range = findRangeLocked(propId);
+    auto snapshot = loadValues(getShard(propId));
+    auto range = findRange(*snapshot, propId);
     for (auto it = range.first; it != range.second; ++it) {
-        values.push_back(it->second);
+        values.push_back(*std::atomic_load(&it->second->value));
     }
 
     return values;
@@ -94,35 +134,60 @@ std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_
 
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         const VehiclePropValue& request) const {
-    MuxGuard g(mLock);
-    RecordId recId = getRecordIdLocked(request);
-    const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
+    auto internalValue = findValue(request);
     return internalValue ? std::make_unique<VehiclePropValue>(*internalValue) : nullptr;
 }
 
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         int32_t prop, int32_t area, int64_t token) const {
     RecordId recId = {prop, isGlobalProp(prop) ? 0 : area, token };
-    MuxGuard g(mLock);
-    const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
+    auto internalValue = findValue(recId);
     return internalValue ? std::make_unique<VehiclePropValue>(*internalValue) : nullptr;
 }
 
+bool VehiclePropertyStore::readValue(const VehiclePropValue& request,
+                                     VehiclePropValue* outValue) const {
+    auto internalValue = findValue(request);
+    return copyValue(internalValue.get(), outValue);
+}
+
+bool VehiclePropertyStore::readValue(int32_t prop, int32_t area, int64_t token,
+                                     VehiclePropValue* outValue) const {
+    RecordId recId = {prop, isGlobalProp(prop) ? 0 : area, token };
+    auto internalValue = findValue(recId);
+    return copyValue(internalValue.get(), outValue);
+}
+
+VehiclePropValuePool::RecyclableType VehiclePropertyStore::readPooledValueOrNull(
+        VehiclePropValuePool* pool, const VehiclePropValue& request) const {
+    auto internalValue = findValue(request);
+    return internalValue ? pool->obtain(*internalValue) : VehiclePropValuePool::RecyclableType();
+}
+
+VehiclePropValuePool::RecyclableType VehiclePropertyStore::readPooledValueOrNull(
+        VehiclePropValuePool* pool, int32_t prop, int32_t area, int64_t token) const {
+    RecordId recId = {prop, isGlobalProp(prop) ? 0 : area, token };
+    auto internalValue = findValue(recId);
+    return internalValue ? pool->obtain(*internalValue) : VehiclePropValuePool::RecyclableType();
+}
 
 std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
-    MuxGuard g(mLock);
     std::vector<VehiclePropConfig> configs;
-    configs.reserve(mConfigs.size());
-    for (auto&& recordConfigIt: mConfigs) {
-        configs.push_back(recordConfigIt.second.propConfig);
+    for (const Shard& shard : mShards) {
+        auto shardConfigs = loadConfigs(shard);
+        for (auto&& recordConfigIt: *shardConfigs) {
+            configs.push_back(recordConfigIt.second->propConfig);
+        }
     }
     return configs;
 }
 
 const VehiclePropConfig* VehiclePropertyStore::getConfigOrNull(int32_t propId) const {
-    MuxGuard g(mLock);
-    auto recordConfigIt = mConfigs.find(propId);
-    return recordConfigIt != mConfigs.end() ? &recordConfigIt->second.propConfig : nullptr;
+    auto configs = loadConfigs(getShard(propId));
+    auto recordConfigIt = configs->find(propId);
+    // RecordConfig objects are never removed and are shared between snapshots, thus returned
+    // pointer remains valid for the lifetime of the store.
+    return recordConfigIt != configs->end() ? &recordConfigIt->second->propConfig : nullptr;
 }
 
 const VehiclePropConfig* VehiclePropertyStore::getConfigOrDie(int32_t propId) const {
@@ -134,33 +199,67 @@ const VehiclePropConfig* VehiclePropertyStore::getConfigOrDie(int32_t propId) co
     return cfg;
 }
 
-VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordIdLocked(
-        const VehiclePropValue& valuePrototype) const {
+size_t VehiclePropertyStore::getShardIndex(int32_t propId) {
+    // Multiplicative hash, property IDs of the same group / type differ only in low bits.
+    return (static_cast<uint32_t>(propId) * 2654435761u) >> 28;
+}
+
+VehiclePropertyStore::Shard& VehiclePropertyStore::getShard(int32_t propId) {
+    return mShards[getShardIndex(propId)];
+}
+
+const VehiclePropertyStore::Shard& VehiclePropertyStore::getShard(int32_t propId) const {
+    return mShards[getShardIndex(propId)];
+}
+
+std::shared_ptr<const VehiclePropertyStore::ConfigMap> VehiclePropertyStore::loadConfigs(
+        const Shard& shard) {
+    return std::atomic_load(&shard.configs);
+}
+
+std::shared_ptr<const VehiclePropertyStore::PropertyMap> VehiclePropertyStore::loadValues(
+        const Shard& shard) {
+    return std::atomic_load(&shard.values);
+}
+
+VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordId(
+        const ConfigMap& configs, const VehiclePropValue& valuePrototype) const {
     RecordId recId = {
         .prop = valuePrototype.prop,
         .area = isGlobalProp(valuePrototype.prop) ? 0 : valuePrototype.areaId,
         .token = 0
     };
 
-    auto it = mConfigs.find(recId.prop);
-    if (it == mConfigs.end()) return {};
+    auto it = configs.find(recId.prop);
+    if (it == configs.end()) return {};
 
-    if (it->second.tokenFunction != nullptr) {
-        recId.token = it->second.tokenFunction(valuePrototype);
+    if (it->second->tokenFunction != nullptr) {
+        recId.token = it->second->tokenFunction(valuePrototype);
     }
     return recId;
 }
 
-const VehiclePropValue* VehiclePropertyStore::getValueOrNullLocked(
-        const VehiclePropertyStore::RecordId& recId) const  {
-    auto it = mPropertyValues.find(recId);
-    return it == mPropertyValues.end() ? nullptr : &it->second;
+std::shared_ptr<const VehiclePropValue> VehiclePropertyStore::findValue(
+        const VehiclePropertyStore::RecordId& recId) const {
+    auto values = loadValues(getShard(recId.prop));
+    auto it = values->find(recId);
+    return it == values->end() ? nullptr : std::atomic_load(&it->second->value);
+}
+
+std::shared_ptr<const VehiclePropValue> VehiclePropertyStore::findValue(
+        const VehiclePropValue& request) const {
+    const Shard& shard = getShard(request.prop);
+    RecordId recId = getRecordId(*loadConfigs(shard), request);
+    auto values = loadValues(shard);
+    auto it = values->find(recId);
+    return it == values->end() ? nullptr : std::atomic_load(&it->second->value);
 }
 
-VehiclePropertyStore::PropertyMapRange VehiclePropertyStore::findRangeLocked(int32_t propId) const {
-    // Based on the fact that mPropertyValues is a sorted map by RecordId.
-    auto beginIt = mPropertyValues.lower_bound( RecordId { propId, INT32_MIN, 0 });
-    auto endIt = mPropertyValues.lower_bound( RecordId { propId + 1, INT32_MIN, 0 });
+VehiclePropertyStore::PropertyMapRange VehiclePropertyStore::findRange(const PropertyMap& values,
+                                                                       int32_t propId) {
+    // Based on the fact that values is a sorted map by RecordId.
+    auto beginIt = values.lower_bound( RecordId { propId, INT32_MIN, 0 });
+    auto endIt = values.lower_bound( RecordId { propId + 1, INT32_MIN, 0 });
 
     return  PropertyMapRange { beginIt, endIt };
 }
@@ -78,17 +78,21 @@ size_t getVehicleRawValueVectorSize(
 
 template<typename T>
 inline void copyHidlVec(hidl_vec <T>* dest, const hidl_vec <T>& src) {
-    for (size_t i = 0; i < std::min(dest->size(), src.size()); i++) {
+    if (dest->size() != src.size()) {
+        dest->resize(src.size());
+    }
+    for (size_t i = 0; i < src.size(); i++) {
         (*dest)[i] = src[i];
     }
 }
 
 void copyVehicleRawValue(VehiclePropValue::RawValue* dest,
                          const VehiclePropValue::RawValue& src) {
-    dest->int32Values = src.int32Values;
-    dest->floatValues = src.floatValues;
-    dest->int64Values = src.int64Values;
-    dest->bytes = src.bytes;
+    // Element-wise copy reuses dest buffers, e.g. pooled values of the same shape.
+    copyHidlVec(&dest->int32Values, src.int32Values);
+    copyHidlVec(&dest->floatValues, src.floatValues);
+    copyHidlVec(&dest->int64Values, src.int64Values);
+    copyHidlVec(&dest->bytes, src.bytes);
     dest->stringValue = src.stringValue;
 }
 
@@ -119,10 +119,7 @@ VehicleHal::VehiclePropValuePtr EmulatedVehicleHal::get(
             *outStatus = fillObd2DtcInfo(v.get());
             break;
         default:
-            auto internalPropValue = mPropStore->readValueOrNull(requestedPropValue);
-            if (internalPropValue != nullptr) {
-                v = getValuePool()->obtain(*internalPropValue);
-            }
+            v = mPropStore->readPooledValueOrNull(&pool, requestedPropValue);
 
             *outStatus = v != nullptr ? StatusCode::OK : StatusCode::INVALID_ARG;
             break;
@@ -231,10 +228,7 @@ void EmulatedVehicleHal::onContinuousPropertyTimer(const std::vector<int32_t>& p
 
     for (int32_t property : properties) {
         if (isContinuousProperty(property)) {
-            auto internalPropValue = mPropStore->readValueOrNull(property);
-            if (internalPropValue != nullptr) {
-                v = pool.obtain(*internalPropValue);
-            }
+            v = mPropStore->readPooledValueOrNull(&pool, property);
         } else {
             ALOGE("Unexpected onContinuousPropertyTimer for property: 0x%x", property);
         }
@@ -14,7 +14,11 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <iostream>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
 
 #include <gtest/gtest.h>
 
@@ -70,4 +74,100 @@ TEST(RecurrentTimerTest, multipleIntervals) {
     ASSERT_EQ_WITH_TOLERANCE(20, counter5ms.load(), 5);
 }
 
+TEST(RecurrentTimerTest, unregister) {
+    std::atomic<int64_t> counter { 0L };
+    auto counterRef = std::ref(counter);
+    RecurrentTimer timer([&counterRef](const std::vector<int32_t>& cookies) {
+        for (int32_t cookie : cookies) {
+            ASSERT_EQ(0xdead, cookie);
+            counterRef.get()++;
+        }
+    });
+
+    timer.registerRecurrentEvent(milliseconds(1), 0xdead);
+    timer.registerRecurrentEvent(milliseconds(1), 0xbeef);
+    timer.unregisterRecurrentEvent(0xbeef);
+    // Re-registering with another interval must not leave the old schedule behind.
+    timer.registerRecurrentEvent(milliseconds(2), 0xdead);
+    std::this_thread::sleep_for(milliseconds(100));
+    ASSERT_EQ_WITH_TOLERANCE(50, counter.load(), 15);
+}
+
+TEST(RecurrentTimerTest, coalescingSlack) {
+    std::atomic<int64_t> wakeUps { 0L };
+    std::atomic<int64_t> events { 0L };
+    auto wakeUpsRef = std::ref(wakeUps);
+    auto eventsRef = std::ref(events);
+    RecurrentTimer timer([&wakeUpsRef, &eventsRef](const std::vector<int32_t>& cookies) {
+        wakeUpsRef.get()++;
+        eventsRef.get() += cookies.size();
+    }, milliseconds(5));
+
+    // Phases of these intervals differ, but all of them fall within the slack.
+    timer.registerRecurrentEvent(milliseconds(10), 1);
+    timer.registerRecurrentEvent(nanoseconds(10100000), 2);
+    timer.registerRecurrentEvent(nanoseconds(10200000), 3);
+    std::this_thread::sleep_for(milliseconds(200));
+    ASSERT_LE(wakeUps.load() * 2, events.load());
+}
+
+TEST(RecurrentTimerTest, workerPool) {
+    std::atomic<int64_t> counter { 0L };
+    auto counterRef = std::ref(counter);
+    RecurrentTimer timer([&counterRef](const std::vector<int32_t>& cookies) {
+        counterRef.get() += cookies.size();
+        // Slow action must not delay the timer thread.
+        std::this_thread::sleep_for(milliseconds(3));
+    }, nanoseconds(0), 4);
+
+    timer.registerRecurrentEvent(milliseconds(1), 0xdead);
+    std::this_thread::sleep_for(milliseconds(100));
+    ASSERT_EQ_WITH_TOLERANCE(100, counter.load(), 20);
+}
+
+TEST(RecurrentTimerTest, jitterBenchmark) {
+    // Registers 1k events with mixed intervals and measures how late they are delivered.
+    const int kEvents = 1000;
+    const auto kDuration = milliseconds(500);
+
+    using Clock = std::chrono::steady_clock;
+    std::mutex lock;
+    std::vector<int64_t> lateness;
+    std::unordered_map<int32_t, nanoseconds> intervals;
+    for (int i = 0; i < kEvents; i++) {
+        intervals[i] = milliseconds(10 + (i % 10) * 10);
+    }
+    lateness.reserve(kEvents * 100);
+
+    // The first occurrence of every event is scheduled in the past, skip it.
+    auto warmUpEnd = (Clock::now() + milliseconds(100)).time_since_epoch().count();
+    RecurrentTimer timer([&](const std::vector<int32_t>& cookies) {
+        auto now = Clock::now().time_since_epoch().count();
+        if (now < warmUpEnd) return;
+        std::lock_guard<std::mutex> g(lock);
+        for (int32_t cookie : cookies) {
+            // Events are aligned to multiples of their interval.
+            lateness.push_back(now % intervals[cookie].count());
+        }
+    });
+
+    for (int i = 0; i < kEvents; i++) {
+        timer.registerRecurrentEvent(intervals[i], i);
+    }
+    std::this_thread::sleep_for(kDuration);
+    for (int i = 0; i < kEvents; i++) {
+        timer.unregisterRecurrentEvent(i);
+    }
+
+    std::lock_guard<std::mutex> g(lock);
+    ASSERT_FALSE(lateness.empty());
+    std::sort(lateness.begin(), lateness.end());
+    int64_t median = lateness[lateness.size() / 2];
+    int64_t p99 = lateness[lateness.size() * 99 / 100];
+    std::cout << "events: " << lateness.size()
+              << ", median lateness: " << median / 1000 << "us"
+              << ", p99 lateness: " << p99 / 1000 << "us" << std::endl;
+    ASSERT_GT(5000000, median);  // 5ms
+}
+
 }  // anonymous namespace
@@ -16,10 +16,15 @@
 
 #include <functional>
 #include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
 #include <unordered_map>
 
 #include <gtest/gtest.h>
 
+#include <utils/SystemClock.h>
+
 #include "vhal_v2_0/SubscriptionManager.h"
 
 #include "VehicleHalTestUtils.h"
@@ -34,6 +39,73 @@ namespace {
 
 using namespace std::placeholders;
 
+// Routing of values to clients as SubscriptionManager did it before the dispatch table: a map of
+// property to the sorted vector of its clients, every client checking its own subscriptions.
+// Kept here to benchmark the dispatch table against.
+class MapBasedSubscriptions {
+public:
+    void subscribe(const sp<HalClient>& client, const SubscribeOptions& opts) {
+        MuxGuard g(mLock);
+        client->addOrUpdateSubscription(opts);
+        auto it = mPropToClients.find(opts.propId);
+        if (it == mPropToClients.end()) {
+            it = mPropToClients.insert(std::make_pair(opts.propId, new HalClientVector())).first;
+        }
+        it->second->addOrUpdate(client);
+    }
+
+    std::list<HalClientValues> distributeValuesToClients(
+            const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
+            SubscribeFlags flags) const {
+        std::map<sp<HalClient>, std::list<VehiclePropValue*>> clientValuesMap;
+
+        {
+            MuxGuard g(mLock);
+            for (const auto& propValue: propValues) {
+                VehiclePropValue* v = propValue.get();
+                auto clients = getSubscribedClientsLocked(v->prop, v->areaId, flags);
+                for (const auto& client : clients) {
+                    clientValuesMap[client].push_back(v);
+                }
+            }
+        }
+
+        std::list<HalClientValues> clientValues;
+        for (const auto& entry : clientValuesMap) {
+            clientValues.push_back(HalClientValues {
+                .client = entry.first,
+                .values = entry.second
+            });
+        }
+
+        return clientValues;
+    }
+
+private:
+    using MuxGuard = std::lock_guard<std::mutex>;
+
+    std::list<sp<HalClient>> getSubscribedClientsLocked(
+            int32_t propId, int32_t area, SubscribeFlags flags) const {
+        std::list<sp<HalClient>> subscribedClients;
+
+        auto it = mPropToClients.find(propId);
+        if (it != mPropToClients.end()) {
+            const sp<HalClientVector>& propClients = it->second;
+            for (size_t i = 0; i < propClients->size(); i++) {
+                const auto& client = propClients->itemAt(i);
+                if (client->isSubscribed(propId, area, flags)) {
+                    subscribedClients.push_back(client);
+                }
+            }
+        }
+
+        return subscribedClients;
+    }
+
+    mutable std::mutex mLock;
+    std::map<int32_t, sp<HalClientVector>> mPropToClients;
+};
+
 class SubscriptionManagerTest : public ::testing::Test {
 public:
     SubscriptionManagerTest() : manager(([this](int x) { onPropertyUnsubscribed(x); })) {}
@@ -229,6 +301,110 @@ TEST_F(SubscriptionManagerTest, unsubscribe) {
     assertLastUnsubscribedProperty(PROP1);
 }
 
+TEST_F(SubscriptionManagerTest, distributeValuesToClients) {
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(1, cb1, subscrToProp1, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(2, cb2, subscrToProp1and2, &updatedOptions));
+
+    VehiclePropValuePool pool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    values.push_back(pool.obtainInt32(1));
+    values.back()->prop = PROP1;
+    values.back()->areaId = toInt(VehicleAreaZone::ROW_1_LEFT);
+    values.push_back(pool.obtainInt32(2));
+    values.back()->prop = PROP1;
+    values.back()->areaId = toInt(VehicleAreaZone::ROW_2_LEFT);  // Nobody subscribed.
+    values.push_back(pool.obtainInt32(3));
+    values.back()->prop = PROP2;
+
+    HalClientValuesBatch batch;
+    manager.distributeValuesToClients(values, SubscribeFlags::HAL_EVENT, &batch);
+    ASSERT_EQ(2u, batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (batch.clientAt(i)->getCallback() == cb1) {
+            ASSERT_EQ(1u, batch.values[i].size());
+            ASSERT_EQ(values[0].get(), batch.values[i][0]);
+        } else {
+            ASSERT_EQ(cb2, batch.clientAt(i)->getCallback());
+            ASSERT_EQ(2u, batch.values[i].size());
+            ASSERT_EQ(values[0].get(), batch.values[i][0]);
+            ASSERT_EQ(values[2].get(), batch.values[i][1]);
+        }
+    }
+
+    // Nothing is delivered once client unsubscribed.
+    manager.unsubscribe(1, PROP1);
+    manager.distributeValuesToClients(values, SubscribeFlags::HAL_EVENT, &batch);
+    size_t total = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+        ASSERT_EQ(cb2, batch.clientAt(i)->getCallback());
+        total += batch.values[i].size();
+    }
+    ASSERT_EQ(2u, total);
+}
+
+TEST_F(SubscriptionManagerTest, distributeValuesToClientsBenchmark) {
+    // 50 clients subscribed to 300 properties each, every batch has a value for every property.
+    const int kClients = 50;
+    const int kProps = 300;
+    const int kBatches = 200;
+    const int32_t kFirstProp = 0x21400100;  // VENDOR | GLOBAL | INT32
+
+    std::vector<sp<IVehicleCallback>> callbacks;
+    hidl_vec<SubscribeOptions> options;
+    options.resize(kProps);
+    for (int p = 0; p < kProps; p++) {
+        options[p] = SubscribeOptions {
+            .propId = kFirstProp + p,
+            .flags = SubscribeFlags::HAL_EVENT
+        };
+    }
+    std::list<SubscribeOptions> updatedOptions;
+    MapBasedSubscriptions mapBased;
+    for (int c = 0; c < kClients; c++) {
+        callbacks.push_back(new MockedVehicleCallback());
+        ASSERT_EQ(StatusCode::OK, manager.addOrUpdateSubscription(
+                100 + c, callbacks.back(), options, &updatedOptions));
+        sp<HalClient> client = new HalClient(callbacks.back());
+        for (int p = 0; p < kProps; p++) {
+            mapBased.subscribe(client, options[p]);
+        }
+    }
+
+    VehiclePropValuePool pool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (int p = 0; p < kProps; p++) {
+        values.push_back(pool.obtainInt32(p));
+        values.back()->prop = kFirstProp + p;
+    }
+
+    HalClientValuesBatch batch;
+    auto start = elapsedRealtimeNano();
+    for (int i = 0; i < kBatches; i++) {
+        manager.distributeValuesToClients(values, SubscribeFlags::HAL_EVENT, &batch);
+    }
+    auto tableNanos = (elapsedRealtimeNano() - start) / kBatches;
+
+    ASSERT_EQ(static_cast<size_t>(kClients), batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        ASSERT_EQ(static_cast<size_t>(kProps), batch.values[i].size());
+    }
+
+    start = elapsedRealtimeNano();
+    for (int i = 0; i < kBatches; i++) {
+        auto clientValues = mapBased.distributeValuesToClients(values, SubscribeFlags::HAL_EVENT);
+        ASSERT_EQ(static_cast<size_t>(kClients), clientValues.size());
+        ASSERT_EQ(static_cast<size_t>(kProps), clientValues.front().values.size());
+    }
+    auto mapNanos = (elapsedRealtimeNano() - start) / kBatches;
+
+    std::cout << "distributeValuesToClients, " << kClients << " clients x " << kProps
+              << " props, per batch: dispatch table " << tableNanos / 1000 << "us"
+              << ", property to clients map " << mapNanos / 1000 << "us" << std::endl;
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
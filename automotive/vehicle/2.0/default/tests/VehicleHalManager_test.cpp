@@ -141,6 +141,39 @@ private:
     std::unordered_map<int64_t, VehiclePropValue> mValues;
 };
 
+// Blocks in onPropertyEvent() until released, to simulate a slow client.
+class BlockingVehicleCallback : public MockedVehicleCallback {
+public:
+    Return<void> onPropertyEvent(const hidl_vec<VehiclePropValue>& values) override {
+        {
+            std::unique_lock<std::mutex> g(mBlockLock);
+            mBlocked = true;
+            mBlockCond.notify_all();
+            mBlockCond.wait(g, [this] { return mReleased; });
+        }
+        return MockedVehicleCallback::onPropertyEvent(values);
+    }
+
+    bool waitUntilBlocked() {
+        std::unique_lock<std::mutex> g(mBlockLock);
+        return mBlockCond.wait_for(g, kTimeout, [this] { return mBlocked; });
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> g(mBlockLock);
+            mReleased = true;
+        }
+        mBlockCond.notify_all();
+    }
+
+private:
+    std::mutex mBlockLock;
+    std::condition_variable mBlockCond;
+    bool mBlocked = false;
+    bool mReleased = false;
+};
+
 class VehicleHalManagerTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -295,6 +328,65 @@ TEST_F(VehicleHalManagerTest, subscribe) {
               toString(cb->getReceivedEvents().front()[0]));
 }
 
+TEST_F(VehicleHalManagerTest, debugDump_DeliveryLatency) {
+    const auto PROP = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+
+    sp<MockedVehicleCallback> cb = new MockedVehicleCallback();
+
+    hidl_vec<SubscribeOptions> options = {
+        SubscribeOptions {
+            .propId = PROP,
+            .flags = SubscribeFlags::DEFAULT
+        }
+    };
+    ASSERT_EQ(StatusCode::OK, manager->subscribe(cb, options));
+
+    auto value = objectPool->obtain(VehiclePropertyType::INT32);
+    value->prop = PROP;
+    value->timestamp = elapsedRealtimeNano();
+    hal->sendPropEvent(std::move(value));
+    ASSERT_TRUE(cb->waitForExpectedEvents(1));
+
+    std::string dump;
+    manager->debugDump([&dump](const hidl_string& s) { dump = s; });
+
+    ASSERT_NE(std::string::npos, dump.find("HAL event batching latency:\n  count: 1"))
+            << dump;
+    // Histogram is updated right after callback returned, thus it may not be visible yet.
+    ASSERT_NE(std::string::npos, dump.find("HAL event delivery latency, all clients:")) << dump;
+}
+
+TEST_F(VehicleHalManagerTest, subscribe_BlockedClientDoesNotDelayOthers) {
+    const auto PROP = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+
+    sp<BlockingVehicleCallback> slowCb = new BlockingVehicleCallback();
+    sp<MockedVehicleCallback> cb = new MockedVehicleCallback();
+
+    hidl_vec<SubscribeOptions> options = {
+        SubscribeOptions {
+            .propId = PROP,
+            .flags = SubscribeFlags::DEFAULT
+        }
+    };
+    ASSERT_EQ(StatusCode::OK, manager->subscribe(slowCb, options));
+    ASSERT_EQ(StatusCode::OK, manager->subscribe(cb, options));
+
+    auto value = objectPool->obtain(VehiclePropertyType::INT32);
+    value->prop = PROP;
+    hal->sendPropEvent(std::move(value));
+    ASSERT_TRUE(slowCb->waitUntilBlocked());
+    ASSERT_TRUE(cb->waitForExpectedEvents(1));
+
+    // Later events still reach the other client while the slow one is stuck in its callback.
+    value = objectPool->obtain(VehiclePropertyType::INT32);
+    value->prop = PROP;
+    hal->sendPropEvent(std::move(value));
+    ASSERT_TRUE(cb->waitForExpectedEvents(2));
+
+    slowCb->release();
+    ASSERT_TRUE(slowCb->waitForExpectedEvents(2));
+}
+
 TEST_F(VehicleHalManagerTest, subscribe_WriteOnly) {
     const auto PROP = toInt(VehicleProperty::HVAC_SEAT_TEMPERATURE);
 
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <iostream>
+#include <set>
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -122,6 +124,110 @@ TEST_F(VehicleObjectPoolTest, valuePoolMultithreadedBenchmark) {
                                  // Typically it takes about 0.1s on Nexus6P.
 }
 
+TEST_F(VehicleObjectPoolTest, valuePoolVectorSizesUseDistinctSlots) {
+    void* raw1 = valuePool->obtain(VehiclePropertyType::INT32_VEC, 1).get();
+    void* raw2 = valuePool->obtain(VehiclePropertyType::INT32_VEC, 2).get();
+    ASSERT_NE(raw1, raw2);
+
+    auto v1 = valuePool->obtain(VehiclePropertyType::INT32_VEC, 1);
+    auto v2 = valuePool->obtain(VehiclePropertyType::INT32_VEC, 2);
+    ASSERT_EQ(raw1, v1.get());
+    ASSERT_EQ(raw2, v2.get());
+    ASSERT_EQ(1u, v1->value.int32Values.size());
+    ASSERT_EQ(2u, v2->value.int32Values.size());
+}
+
+TEST_F(VehicleObjectPoolTest, valuePoolCapacity) {
+    valuePool.reset(new VehiclePropValuePool(4, 2));
+    {
+        std::vector<recyclable_ptr<VehiclePropValue>> vec;
+        for (int i = 0; i < 4; i++) {
+            vec.push_back(valuePool->obtain(VehiclePropertyType::INT32));
+        }
+    }
+    // Only 2 objects were kept, the rest should be created again.
+    std::vector<recyclable_ptr<VehiclePropValue>> vec;
+    for (int i = 0; i < 4; i++) {
+        vec.push_back(valuePool->obtain(VehiclePropertyType::INT32));
+    }
+    ASSERT_EQ(6u, stats->Created);
+}
+
+TEST(LockFreeFreeListTest, concurrentPushPop) {
+    const int T = 4;
+    const int N = 10000;
+
+    LockFreeFreeList<int> list(64);
+    std::vector<std::vector<int*>> popped(T);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < T; i++) {
+        threads.push_back(std::thread([&list, &popped, i] () {
+            for (int j = 0; j < N; j++) {
+                int* o = new int(i * N + j);
+                while (!list.push(o)) {
+                    int* p = list.pop();
+                    if (p != nullptr) popped[i].push_back(p);
+                }
+                int* p = list.pop();
+                if (p != nullptr) popped[i].push_back(p);
+            }
+        }));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    int* o;
+    while ((o = list.pop()) != nullptr) {
+        popped[0].push_back(o);
+    }
+
+    // Every pushed object must be popped exactly once.
+    std::set<int> values;
+    for (auto& vec : popped) {
+        for (int* p : vec) {
+            ASSERT_TRUE(values.insert(*p).second);
+            delete p;
+        }
+    }
+    ASSERT_EQ(static_cast<size_t>(T * N), values.size());
+}
+
+TEST_F(VehicleObjectPoolTest, valuePoolThreadScalingBenchmark) {
+    // Measures obtain / recycle throughput with 1 to 8 threads, each thread
+    // holding a small working set of values like a HAL event loop does.
+    const int C = 20000;
+    const int O = 8;
+
+    auto poolPtr = valuePool.get();
+    for (int T = 1; T <= 8; T *= 2) {
+        std::vector<std::thread> threads;
+        auto start = elapsedRealtimeNano();
+        for (int i = 0; i < T; i++) {
+            threads.push_back(std::thread([&poolPtr] () {
+                for (int j = 0; j < C; j++) {
+                    recyclable_ptr<VehiclePropValue> vec[O];
+                    for (int k = 0; k < O; k++) {
+                        vec[k] = poolPtr->obtain(k % 2 == 0
+                                                 ? VehiclePropertyType::FLOAT
+                                                 : VehiclePropertyType::INT32);
+                    }
+                }
+            }));
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        auto elapsedNs = elapsedRealtimeNano() - start;
+
+        int64_t ops = static_cast<int64_t>(T) * C * O;
+        std::cout << "threads: " << T
+                  << ", obtain/recycle per second: "
+                  << ops * 1000000000 / (elapsedNs > 0 ? elapsedNs : 1)
+                  << std::endl;
+        ASSERT_GE(static_cast<uint32_t>(8 * O), stats->Created);
+    }
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
@@ -27,6 +27,8 @@
 #include <log/log.h>
 #include <vector>
 #include "fcntl.h"
+#include "sys/epoll.h"
+#include "sys/eventfd.h"
 #include "sys/select.h"
 #include "unistd.h"
 
@@ -40,11 +42,29 @@ namespace bluetooth {
 namespace async {
 
 int AsyncFdWatcher::WatchFdForNonBlockingReads(
-    int file_descriptor, const ReadCallback& on_read_fd_ready_callback) {
+    int file_descriptor, const ReadCallback& on_read_fd_ready_callback,
+    Trigger trigger) {
+  if (backend_ == Backend::EPOLL && trigger == Trigger::EDGE) {
+    int flags = fcntl(file_descriptor, F_GETFL);
+    if (flags < 0 || fcntl(file_descriptor, F_SETFL, flags | O_NONBLOCK) < 0) {
+      ALOGE("%s unable to make fd %d non-blocking: %s", __func__,
+            file_descriptor, strerror(errno));
+      return -1;
+    }
+  }
+
   // Add file descriptor and callback
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
-    watched_fds_[file_descriptor] = on_read_fd_ready_callback;
+    WatchedFd& watched_fd = watched_fds_[file_descriptor];
+    watched_fd.callback =
+        std::make_shared<ReadCallback>(on_read_fd_ready_callback);
+    watched_fd.trigger = trigger;
+    // If the thread is running already, register with it directly.
+    if (epoll_fd_ != INVALID_FD &&
+        EpollAddLocked(file_descriptor, watched_fd) != 0) {
+      return -1;
+    }
   }
 
   // Start the thread if not started yet
@@ -74,6 +94,35 @@ AsyncFdWatcher::~AsyncFdWatcher() {}
 int AsyncFdWatcher::tryStartThread() {
   if (std::atomic_exchange(&running_, true)) return 0;
 
+  if (backend_ == Backend::EPOLL) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) return -1;
+    int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) {
+      close(epoll_fd);
+      return -1;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = event_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event) != 0) {
+      close(event_fd);
+      close(epoll_fd);
+      return -1;
+    }
+    notification_listen_fd_ = event_fd;
+    notification_write_fd_ = event_fd;
+
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    epoll_fd_ = epoll_fd;
+    for (auto& it : watched_fds_) {
+      EpollAddLocked(it.first, it.second);
+    }
+    thread_ = std::thread([this]() { EpollThreadRoutine(); });
+    if (!thread_.joinable()) return -1;
+    return 0;
+  }
+
   // Set up the communication channel
   int pipe_fds[2];
   if (pipe2(pipe_fds, O_NONBLOCK)) return -1;
@@ -91,13 +140,23 @@ int AsyncFdWatcher::stopThread() {
   if (!std::atomic_exchange(&running_, false)) return 0;
 
   notifyThread();
+  bool joined = false;
   if (std::this_thread::get_id() != thread_.get_id()) {
     thread_.join();
+    joined = true;
   }
 
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
     watched_fds_.clear();
+    // The thread still uses the descriptors if it stopped itself.
+    if (epoll_fd_ != INVALID_FD && joined) {
+      close(epoll_fd_);
+      close(notification_listen_fd_);
+      epoll_fd_ = INVALID_FD;
+      notification_listen_fd_ = INVALID_FD;
+      notification_write_fd_ = INVALID_FD;
+    }
   }
 
   {
@@ -109,6 +168,15 @@ int AsyncFdWatcher::stopThread() {
 }
 
 int AsyncFdWatcher::notifyThread() {
+  if (backend_ == Backend::EPOLL) {
+    uint64_t value = 1;
+    if (TEMP_FAILURE_RETRY(write(notification_write_fd_, &value,
+                                 sizeof(value))) < 0) {
+      return -1;
+    }
+    return 0;
+  }
+
   uint8_t buffer[] = {0};
   if (TEMP_FAILURE_RETRY(write(notification_write_fd_, &buffer, 1)) < 0) {
     return -1;
@@ -116,7 +184,7 @@ int AsyncFdWatcher::notifyThread() {
   return 0;
 }
 
-void AsyncFdWatcher::ThreadRoutine() {
+void AsyncFdWatcher::SetUpThreadPriority() {
   // Make watching thread RT.
   struct sched_param rt_params;
   rt_params.sched_priority = BT_RT_PRIORITY;
@@ -124,6 +192,87 @@ void AsyncFdWatcher::ThreadRoutine() {
     ALOGE("%s unable to set SCHED_FIFO for pid %d, tid %d, error %s", __func__,
           getpid(), gettid(), strerror(errno));
   }
+}
+
+void AsyncFdWatcher::RunTimeoutCallback() {
+  // Allow the timeout callback to modify the timeout.
+  TimeoutCallback saved_cb;
+  {
+    std::unique_lock<std::mutex> guard(timeout_mutex_);
+    if (timeout_ms_ > std::chrono::milliseconds(0))
+      saved_cb = timeout_cb_;
+  }
+  if (saved_cb != nullptr)
+    saved_cb();
+}
+
+int AsyncFdWatcher::EpollAddLocked(int file_descriptor,
+                                   const WatchedFd& watched_fd) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  if (watched_fd.trigger == Trigger::EDGE) event.events |= EPOLLET;
+  event.data.fd = file_descriptor;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event) == 0) {
+    return 0;
+  }
+  // Watching the same descriptor again replaces its registration.
+  if (errno == EEXIST &&
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, file_descriptor, &event) == 0) {
+    return 0;
+  }
+  ALOGE("%s unable to watch fd %d: %s", __func__, file_descriptor,
+        strerror(errno));
+  return -1;
+}
+
+void AsyncFdWatcher::EpollThreadRoutine() {
+  SetUpThreadPriority();
+
+  const int kMaxEvents = 16;
+  struct epoll_event events[kMaxEvents];
+  while (running_) {
+    int timeout_ms = -1;
+    {
+      std::unique_lock<std::mutex> guard(timeout_mutex_);
+      if (timeout_ms_ > std::chrono::milliseconds(0))
+        timeout_ms = timeout_ms_.count();
+    }
+
+    // Like the select() loop, the timeout restarts on every wakeup.
+    int retval = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+
+    // There was some error.
+    if (retval < 0) continue;
+
+    // Timeout.
+    if (retval == 0) {
+      RunTimeoutCallback();
+      continue;
+    }
+
+    for (int i = 0; i < retval && running_; i++) {
+      int fd = events[i].data.fd;
+      if (fd == notification_listen_fd_) {
+        uint64_t value;
+        TEMP_FAILURE_RETRY(read(notification_listen_fd_, &value, sizeof(value)));
+        continue;
+      }
+
+      // Callbacks are called without holding the lock, so that they can
+      // watch more descriptors or change the timeout.
+      std::shared_ptr<ReadCallback> callback;
+      {
+        std::unique_lock<std::mutex> guard(internal_mutex_);
+        auto it = watched_fds_.find(fd);
+        if (it != watched_fds_.end()) callback = it->second.callback;
+      }
+      if (callback != nullptr) (*callback)(fd);
+    }
+  }
+}
+
+void AsyncFdWatcher::ThreadRoutine() {
+  SetUpThreadPriority();
 
   while (running_) {
     fd_set read_fds;
@@ -152,15 +301,7 @@ void AsyncFdWatcher::ThreadRoutine() {
 
     // Timeout.
     if (retval == 0) {
-      // Allow the timeout callback to modify the timeout.
-      TimeoutCallback saved_cb;
-      {
-        std::unique_lock<std::mutex> guard(timeout_mutex_);
-        if (timeout_ms_ > std::chrono::milliseconds(0))
-          saved_cb = timeout_cb_;
-      }
-      if (saved_cb != nullptr)
-        saved_cb();
+      RunTimeoutCallback();
       continue;
     }
 
@@ -177,7 +318,7 @@ void AsyncFdWatcher::ThreadRoutine() {
       std::unique_lock<std::mutex> guard(internal_mutex_);
       for (auto& it : watched_fds_) {
         if (FD_ISSET(it.first, &read_fds)) {
-        it.second(it.first);
+        (*it.second.callback)(it.first);
         }
       }
     }
@@ -16,7 +16,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <thread>
 
@@ -30,11 +34,19 @@ using TimeoutCallback = std::function<void(void)>;
 
 class AsyncFdWatcher {
  public:
-  AsyncFdWatcher() = default;
+  enum class Backend { SELECT, EPOLL };
+
+  // EDGE only applies to the EPOLL backend. The file descriptor is switched
+  // to non-blocking mode and the callback has to read until EAGAIN.
+  enum class Trigger { LEVEL, EDGE };
+
+  explicit AsyncFdWatcher(Backend backend = Backend::EPOLL)
+      : backend_(backend) {}
   ~AsyncFdWatcher();
 
   int WatchFdForNonBlockingReads(int file_descriptor,
-                                 const ReadCallback& on_read_fd_ready_callback);
+                                 const ReadCallback& on_read_fd_ready_callback,
+                                 Trigger trigger = Trigger::LEVEL);
   int ConfigureTimeout(const std::chrono::milliseconds timeout,
                        const TimeoutCallback& on_timeout_callback);
   void StopWatchingFileDescriptors();
@@ -43,21 +55,33 @@ class AsyncFdWatcher {
   AsyncFdWatcher(const AsyncFdWatcher&) = delete;
   AsyncFdWatcher& operator=(const AsyncFdWatcher&) = delete;
 
+  struct WatchedFd {
+    // Shared so that the callback can run without holding internal_mutex_.
+    std::shared_ptr<ReadCallback> callback;
+    Trigger trigger;
+  };
+
   int tryStartThread();
   int stopThread();
   int notifyThread();
+  void SetUpThreadPriority();
   void ThreadRoutine();
+  void EpollThreadRoutine();
+  int EpollAddLocked(int file_descriptor, const WatchedFd& watched_fd);
+  void RunTimeoutCallback();
 
+  const Backend backend_;
   std::atomic_bool running_{false};
   std::thread thread_;
   std::mutex internal_mutex_;
   std::mutex timeout_mutex_;
 
-  std::map<int, ReadCallback> watched_fds_;
-  int notification_listen_fd_;
-  int notification_write_fd_;
+  std::map<int, WatchedFd> watched_fds_;
+  int notification_listen_fd_{-1};
+  int notification_write_fd_{-1};
+  int epoll_fd_{-1};
   TimeoutCallback timeout_cb_;
-  std::chrono::milliseconds timeout_ms_;
+  std::chrono::milliseconds timeout_ms_{0};
 };
 
 
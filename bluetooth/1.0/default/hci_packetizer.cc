@@ -21,6 +21,7 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <utils/Log.h>
 
@@ -46,56 +47,77 @@ namespace hardware {
 namespace bluetooth {
 namespace hci {
 
+HciPacketizer::HciPacketizer(HciPacketReadyCallback packet_cb)
+    : buffer_(new uint8_t[kBufferSize]), packet_ready_cb_(packet_cb) {}
+
 const hidl_vec<uint8_t>& HciPacketizer::GetPacket() const {
   return packet_;
 }
 
+HciPacketType HciPacketizer::GetPacketType() const {
+  return packet_type_;
+}
+
 void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
-  switch (state_) {
-    case HCI_PREAMBLE: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(
-          read(fd, preamble_ + bytes_read_,
-               preamble_size_for_type[packet_type] - bytes_read_));
-      if (bytes_read <= 0) {
-        LOG_ALWAYS_FATAL_IF((bytes_read == 0),
-                            "%s: Unexpected EOF reading the header!", __func__);
-        LOG_ALWAYS_FATAL("%s: Read header error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_read_ += bytes_read;
-      if (bytes_read_ == preamble_size_for_type[packet_type]) {
-        size_t packet_length =
-            HciGetPacketLengthForType(packet_type, preamble_);
-        packet_.resize(preamble_size_for_type[packet_type] + packet_length);
-        memcpy(packet_.data(), preamble_, preamble_size_for_type[packet_type]);
-        bytes_remaining_ = packet_length;
-        state_ = HCI_PAYLOAD;
-        bytes_read_ = 0;
-      }
-      break;
+  if (fd != fd_) {
+    int flags = fcntl(fd, F_GETFL);
+    fd_ = fd;
+    fd_non_blocking_ = flags >= 0 && (flags & O_NONBLOCK);
+  }
+
+  // Non-blocking descriptors are read until they are drained, which is
+  // required when they are watched edge-triggered.
+  size_t space;
+  ssize_t bytes_read;
+  do {
+    space = kBufferSize - bytes_buffered_;
+    bytes_read = TEMP_FAILURE_RETRY(
+        read(fd, buffer_.get() + bytes_buffered_, space));
+    if (bytes_read <= 0) {
+      if (bytes_read < 0 && errno == EAGAIN) return;
+      LOG_ALWAYS_FATAL_IF((bytes_read == 0),
+                          "%s: Unexpected EOF reading data!", __func__);
+      LOG_ALWAYS_FATAL("%s: Read error: %s", __func__, strerror(errno));
     }
+    bytes_buffered_ += bytes_read;
+    ProcessBufferedData(packet_type);
+  } while (fd_non_blocking_ && static_cast<size_t>(bytes_read) == space);
+}
 
-    case HCI_PAYLOAD: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(read(
-          fd,
-          packet_.data() + preamble_size_for_type[packet_type] + bytes_read_,
-          bytes_remaining_));
-      if (bytes_read <= 0) {
-        LOG_ALWAYS_FATAL_IF((bytes_read == 0),
-                            "%s: Unexpected EOF reading the payload!",
-                            __func__);
-        LOG_ALWAYS_FATAL("%s: Read payload error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_remaining_ -= bytes_read;
-      bytes_read_ += bytes_read;
-      if (bytes_remaining_ == 0) {
-        packet_ready_cb_();
-        state_ = HCI_PREAMBLE;
-        bytes_read_ = 0;
+void HciPacketizer::ProcessBufferedData(HciPacketType packet_type) {
+  const size_t type_size = packet_type == HCI_PACKET_TYPE_UNKNOWN ? 1 : 0;
+  size_t offset = 0;
+  while (bytes_buffered_ - offset > type_size) {
+    const uint8_t* data = buffer_.get() + offset;
+    size_t available = bytes_buffered_ - offset - type_size;
+    HciPacketType type = packet_type;
+    if (type_size != 0) {
+      type = static_cast<HciPacketType>(data[0]);
+      if (type != HCI_PACKET_TYPE_ACL_DATA &&
+          type != HCI_PACKET_TYPE_SCO_DATA && type != HCI_PACKET_TYPE_EVENT) {
+        LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
+                         static_cast<int>(type));
       }
-      break;
+      data += type_size;
     }
+
+    size_t preamble_size = preamble_size_for_type[type];
+    if (available < preamble_size) break;
+    size_t packet_size =
+        preamble_size + HciGetPacketLengthForType(type, data);
+    if (available < packet_size) break;
+
+    packet_type_ = type;
+    packet_.setToExternal(const_cast<uint8_t*>(data), packet_size);
+    packet_ready_cb_();
+    offset += type_size + packet_size;
+  }
+  packet_.setToExternal(nullptr, 0);
+
+  // Move the incomplete packet to the beginning of the buffer.
+  if (offset > 0) {
+    bytes_buffered_ -= offset;
+    memmove(buffer_.get(), buffer_.get() + offset, bytes_buffered_);
   }
 }
 
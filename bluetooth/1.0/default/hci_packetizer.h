@@ -17,6 +17,7 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 
 #include <hidl/HidlSupport.h>
 
@@ -30,20 +31,34 @@ namespace hci {
 using ::android::hardware::hidl_vec;
 using HciPacketReadyCallback = std::function<void(void)>;
 
+// Reads HCI packets from a file descriptor. Each OnDataReady() call reads as
+// much data as is available and reports every complete packet in it, so a
+// single wakeup can deliver several packets. Packets are delivered straight
+// from the read buffer, GetPacket() is only valid during the callback.
 class HciPacketizer {
  public:
-  HciPacketizer(HciPacketReadyCallback packet_cb)
-      : packet_ready_cb_(packet_cb){};
+  HciPacketizer(HciPacketReadyCallback packet_cb);
+
+  // Reads packets of the given type. HCI_PACKET_TYPE_UNKNOWN means that each
+  // packet is preceded by its H4 packet type indicator.
   void OnDataReady(int fd, HciPacketType packet_type);
   const hidl_vec<uint8_t>& GetPacket() const;
+  HciPacketType GetPacketType() const;
 
  protected:
-  enum State { HCI_PREAMBLE, HCI_PAYLOAD };
-  State state_{HCI_PREAMBLE};
-  uint8_t preamble_[HCI_PREAMBLE_SIZE_MAX];
+  // Type indicator + the largest possible ACL packet, plus room for reading
+  // the beginning of the following packets.
+  static const size_t kBufferSize =
+      1 + HCI_ACL_PREAMBLE_SIZE + 0xFFFF + 4096;
+
+  void ProcessBufferedData(HciPacketType packet_type);
+
+  int fd_{-1};
+  bool fd_non_blocking_{false};
+  std::unique_ptr<uint8_t[]> buffer_;
+  size_t bytes_buffered_{0};
   hidl_vec<uint8_t> packet_;
-  size_t bytes_remaining_{0};
-  size_t bytes_read_{0};
+  HciPacketType packet_type_{HCI_PACKET_TYPE_UNKNOWN};
   HciPacketReadyCallback packet_ready_cb_;
 };
 
@@ -18,8 +18,12 @@
 
 #include "async_fd_watcher.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <iostream>
+#include <mutex>
 #include <vector>
 
 #include <log/log.h>
@@ -385,6 +389,106 @@ TEST_F(AsyncFdWatcherSocketTest, RepeatedTimeOutTest) {
   CleanUpServer();
 }
 
+// Edge-triggered callbacks drain the descriptor and are called again for new
+// data.
+TEST_F(AsyncFdWatcherSocketTest, EdgeTriggered) {
+  int sockfd[2];
+  socketpair(AF_LOCAL, SOCK_STREAM, 0, sockfd);
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t bytes_received = 0;
+
+  AsyncFdWatcher watcher(AsyncFdWatcher::Backend::EPOLL);
+  watcher.WatchFdForNonBlockingReads(
+      sockfd[0],
+      [&](int fd) {
+        char read_buf[4];
+        ssize_t n;
+        while ((n = TEMP_FAILURE_RETRY(read(fd, read_buf, sizeof(read_buf)))) >
+               0) {
+          std::unique_lock<std::mutex> lock(mutex);
+          bytes_received += n;
+          cond.notify_one();
+        }
+        EXPECT_TRUE(n < 0 && errno == EAGAIN);
+      },
+      AsyncFdWatcher::Trigger::EDGE);
+
+  char data[10] = "123456789";
+  for (size_t expected : {sizeof(data), 2 * sizeof(data)}) {
+    TEMP_FAILURE_RETRY(write(sockfd[1], data, sizeof(data)));
+    std::unique_lock<std::mutex> lock(mutex);
+    EXPECT_TRUE(cond.wait_for(lock, std::chrono::seconds(1),
+                              [&]() { return bytes_received == expected; }));
+  }
+
+  watcher.StopWatchingFileDescriptors();
+  close(sockfd[0]);
+  close(sockfd[1]);
+}
+
+// Measures the time from a write until the read callback runs.
+static void MeasureWakeupLatency(AsyncFdWatcher::Backend backend,
+                                 const char* name) {
+  const int kIterations = 2000;
+  // Descriptors which are watched but stay idle, as with MCT transports.
+  const int kIdleSocketPairs = 4;
+
+  int sockfd[2];
+  socketpair(AF_LOCAL, SOCK_STREAM, 0, sockfd);
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool received = false;
+  std::chrono::steady_clock::time_point received_time;
+
+  AsyncFdWatcher watcher(backend);
+  std::vector<int> idle_fds;
+  for (int i = 0; i < kIdleSocketPairs; i++) {
+    int idle[2];
+    socketpair(AF_LOCAL, SOCK_STREAM, 0, idle);
+    idle_fds.push_back(idle[0]);
+    idle_fds.push_back(idle[1]);
+    watcher.WatchFdForNonBlockingReads(idle[0], [](int) {});
+  }
+  watcher.WatchFdForNonBlockingReads(sockfd[0], [&](int fd) {
+    char read_buf[1];
+    TEMP_FAILURE_RETRY(read(fd, read_buf, sizeof(read_buf)));
+    std::unique_lock<std::mutex> lock(mutex);
+    received_time = std::chrono::steady_clock::now();
+    received = true;
+    cond.notify_one();
+  });
+  watcher.ConfigureTimeout(std::chrono::seconds(10), []() {});
+
+  std::vector<std::chrono::nanoseconds> latencies;
+  latencies.reserve(kIterations);
+  for (int i = 0; i < kIterations; i++) {
+    std::unique_lock<std::mutex> lock(mutex);
+    received = false;
+    auto sent_time = std::chrono::steady_clock::now();
+    char one_buf[1] = {'1'};
+    TEMP_FAILURE_RETRY(write(sockfd[1], one_buf, sizeof(one_buf)));
+    ASSERT_TRUE(cond.wait_for(lock, std::chrono::seconds(1),
+                              [&]() { return received; }));
+    latencies.push_back(received_time - sent_time);
+  }
+  watcher.StopWatchingFileDescriptors();
+  close(sockfd[0]);
+  close(sockfd[1]);
+  for (int fd : idle_fds) close(fd);
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << name << " wakeup latency: median "
+            << latencies[kIterations / 2].count() / 1000 << " us, p99 "
+            << latencies[kIterations * 99 / 100].count() / 1000 << " us"
+            << std::endl;
+}
+
+TEST(AsyncFdWatcherBenchmark, WakeupLatency) {
+  MeasureWakeupLatency(AsyncFdWatcher::Backend::SELECT, "select");
+  MeasureWakeupLatency(AsyncFdWatcher::Backend::EPOLL, "epoll");
+}
+
 } // namespace implementation
 } // namespace V1_0
 } // namespace bluetooth
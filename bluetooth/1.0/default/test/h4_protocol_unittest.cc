@@ -19,10 +19,14 @@
 #include "h4_protocol.h"
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <iostream>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 #include <log/log.h>
@@ -36,6 +40,7 @@ namespace bluetooth {
 namespace V1_0 {
 namespace implementation {
 
+using ::testing::_;
 using ::testing::Eq;
 using hci::H4Protocol;
 
@@ -79,7 +84,10 @@ class H4ProtocolTest : public ::testing::Test {
         new H4Protocol(sockfd[0], event_cb_.AsStdFunction(),
                        acl_cb_.AsStdFunction(), sco_cb_.AsStdFunction());
     fd_watcher_.WatchFdForNonBlockingReads(
-        sockfd[0], [h4_hci](int fd) { h4_hci->OnDataReady(fd); });
+        sockfd[0], [this, h4_hci](int fd) {
+          reads_++;
+          h4_hci->OnDataReady(fd);
+        });
     protocol_ = h4_hci;
 
     fake_uart_ = sockfd[1];
@@ -190,6 +198,7 @@ class H4ProtocolTest : public ::testing::Test {
   async::AsyncFdWatcher fd_watcher_;
   H4Protocol* protocol_;
   int fake_uart_;
+  std::atomic<int> reads_{0};
 };
 
 // Test sending data sends correct data onto the UART
@@ -206,6 +215,123 @@ TEST_F(H4ProtocolTest, TestReads) {
   WriteAndExpectInboundEvent(event_data);
 }
 
+// Several packets written at once are all delivered.
+TEST_F(H4ProtocolTest, TestMultiplePacketsInOneRead) {
+  // Two ACL packets followed by an event, back to back.
+  std::vector<char> stream;
+  for (char* payload : {acl_data, sample_data1}) {
+    size_t length = strlen(payload);
+    char preamble[5] = {HCI_PACKET_TYPE_ACL_DATA, 19, 92,
+                        static_cast<char>(length & 0xFF),
+                        static_cast<char>((length >> 8) & 0xFF)};
+    stream.insert(stream.end(), preamble, preamble + sizeof(preamble));
+    stream.insert(stream.end(), payload, payload + length);
+  }
+  char event_preamble[3] = {HCI_PACKET_TYPE_EVENT, 9,
+                            static_cast<char>(strlen(event_data))};
+  stream.insert(stream.end(), event_preamble,
+                event_preamble + sizeof(event_preamble));
+  stream.insert(stream.end(), event_data, event_data + strlen(event_data));
+
+  std::mutex mutex;
+  std::condition_variable done;
+  EXPECT_CALL(acl_cb_, Call(_)).Times(2);
+  EXPECT_CALL(event_cb_, Call(HidlVecMatches(event_preamble + 1,
+                                             sizeof(event_preamble) - 1,
+                                             event_data)))
+      .WillOnce(Notify(&mutex, &done));
+
+  std::unique_lock<std::mutex> lock(mutex);
+  TEMP_FAILURE_RETRY(write(fake_uart_, stream.data(), stream.size()));
+  done.wait_for(lock, std::chrono::milliseconds(100));
+}
+
+// A packet which arrives in pieces is delivered once it is complete.
+TEST_F(H4ProtocolTest, TestPacketSplitAcrossReads) {
+  size_t length = strlen(acl_data);
+  char preamble[5] = {HCI_PACKET_TYPE_ACL_DATA, 19, 92,
+                      static_cast<char>(length & 0xFF),
+                      static_cast<char>((length >> 8) & 0xFF)};
+
+  std::mutex mutex;
+  std::condition_variable done;
+  EXPECT_CALL(acl_cb_, Call(HidlVecMatches(preamble + 1, sizeof(preamble) - 1,
+                                           acl_data)))
+      .WillOnce(Notify(&mutex, &done));
+
+  std::unique_lock<std::mutex> lock(mutex);
+  TEMP_FAILURE_RETRY(write(fake_uart_, preamble, 3));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  TEMP_FAILURE_RETRY(write(fake_uart_, preamble + 3, 2));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  TEMP_FAILURE_RETRY(write(fake_uart_, acl_data, length / 2));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  TEMP_FAILURE_RETRY(write(fake_uart_, acl_data + length / 2,
+                           length - length / 2));
+  done.wait_for(lock, std::chrono::milliseconds(100));
+}
+
+// Measures inbound throughput for a stream of ACL packets interleaved with
+// events.
+TEST_F(H4ProtocolTest, TestReadThroughput) {
+  const int kNumPackets = 20000;
+  const int kPacketsPerWrite = 8;
+  const size_t kAclPayloadSize = 120;
+
+  std::vector<char> acl_packet(5 + kAclPayloadSize, 'a');
+  acl_packet[0] = HCI_PACKET_TYPE_ACL_DATA;
+  acl_packet[3] = kAclPayloadSize & 0xFF;
+  acl_packet[4] = (kAclPayloadSize >> 8) & 0xFF;
+  char event_packet[] = {HCI_PACKET_TYPE_EVENT, 0x13, 5, 1, 2, 0, 1, 0};
+
+  std::mutex mutex;
+  std::condition_variable done;
+  std::atomic<int> received{0};
+  auto on_packet = [&](const hidl_vec<uint8_t>&) {
+    if (++received == kNumPackets) {
+      std::unique_lock<std::mutex> lock(mutex);
+      done.notify_one();
+    }
+  };
+  EXPECT_CALL(acl_cb_, Call(_)).WillRepeatedly(testing::Invoke(on_packet));
+  EXPECT_CALL(event_cb_, Call(_)).WillRepeatedly(testing::Invoke(on_packet));
+
+  // The controller side writes a few packets at a time, like a UART driver
+  // handing over its receive buffer.
+  std::vector<char> burst;
+  for (int i = 0; i < kPacketsPerWrite; i++) {
+    if (i % 4 == 3) {
+      burst.insert(burst.end(), event_packet,
+                   event_packet + sizeof(event_packet));
+    } else {
+      burst.insert(burst.end(), acl_packet.begin(), acl_packet.end());
+    }
+  }
+
+  reads_ = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::thread writer([&]() {
+    for (int i = 0; i < kNumPackets; i += kPacketsPerWrite) {
+      TEMP_FAILURE_RETRY(write(fake_uart_, burst.data(), burst.size()));
+    }
+  });
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait_for(lock, std::chrono::seconds(10),
+                  [&]() { return received == kNumPackets; });
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  writer.join();
+
+  ASSERT_EQ(kNumPackets, received);
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << "Received " << kNumPackets << " packets in " << seconds * 1000
+            << " ms, " << static_cast<int>(kNumPackets / seconds)
+            << " packets/s, " << static_cast<double>(reads_) / kNumPackets
+            << " reads/packet" << std::endl;
+  EXPECT_LT(reads_, kNumPackets);
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace bluetooth
@@ -20,6 +20,8 @@
 #include <log/log.h>
 #include <utils/Errors.h>
 
+#include <algorithm>
+
 #include "CameraMetadata.h"
 #include "VendorTagDescriptor.h"
 
@@ -34,22 +36,22 @@ namespace helper {
     (((uintptr_t)(val) + ((alignment) - 1)) & ~((alignment) - 1))
 
 CameraMetadata::CameraMetadata() :
-        mBuffer(NULL), mLocked(false) {
+        mBuffer(NULL), mLocked(false), mIndexValid(false) {
 }
 
 CameraMetadata::CameraMetadata(size_t entryCapacity, size_t dataCapacity) :
-        mLocked(false)
+        mLocked(false), mIndexValid(false)
 {
     mBuffer = allocate_camera_metadata(entryCapacity, dataCapacity);
 }
 
 CameraMetadata::CameraMetadata(const CameraMetadata &other) :
-        mLocked(false) {
+        mLocked(false), mIndexValid(false) {
     mBuffer = clone_camera_metadata(other.mBuffer);
 }
 
 CameraMetadata::CameraMetadata(camera_metadata_t *buffer) :
-        mBuffer(NULL), mLocked(false) {
+        mBuffer(NULL), mLocked(false), mIndexValid(false) {
     acquire(buffer);
 }
 
@@ -102,6 +104,7 @@ camera_metadata_t* CameraMetadata::release() {
     }
     camera_metadata_t *released = mBuffer;
     mBuffer = NULL;
+    invalidateIndex();
     return released;
 }
 
@@ -114,6 +117,7 @@ void CameraMetadata::clear() {
         free_camera_metadata(mBuffer);
         mBuffer = NULL;
     }
+    invalidateIndex();
 }
 
 void CameraMetadata::acquire(camera_metadata_t *buffer) {
@@ -149,6 +153,7 @@ status_t CameraMetadata::append(const camera_metadata_t* other) {
     size_t extraEntries = get_camera_metadata_entry_count(other);
     size_t extraData = get_camera_metadata_data_count(other);
     resizeIfNeeded(extraEntries, extraData);
+    invalidateIndex();
 
     return append_camera_metadata(mBuffer, other);
 }
@@ -167,6 +172,7 @@ status_t CameraMetadata::sort() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
+    invalidateIndex();
     return sort_camera_metadata(mBuffer);
 }
 
@@ -317,18 +323,32 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
     size_t data_size = calculate_camera_metadata_entry_data_size(type,
             data_count);
 
-    res = resizeIfNeeded(1, data_size);
-
+    camera_metadata_entry_t entry;
+    res = (mBuffer == NULL) ? NAME_NOT_FOUND : findEntry(tag, &entry);
     if (res == OK) {
-        camera_metadata_entry_t entry;
-        res = find_camera_metadata_entry(mBuffer, tag, &entry);
-        if (res == NAME_NOT_FOUND) {
-            res = add_camera_metadata_entry(mBuffer,
-                    tag, data, data_count);
-        } else if (res == OK) {
+        // Existing entries are updated in place, so only growth of their data
+        // needs extra space
+        size_t old_data_size = calculate_camera_metadata_entry_data_size(
+                entry.type, entry.count);
+        res = resizeIfNeeded(0,
+                data_size > old_data_size ? data_size - old_data_size : 0);
+        if (res == OK) {
             res = update_camera_metadata_entry(mBuffer,
                     entry.index, data, data_count, NULL);
         }
+    } else if (res == NAME_NOT_FOUND) {
+        res = resizeIfNeeded(1, data_size);
+        if (res == OK) {
+            res = add_camera_metadata_entry(mBuffer,
+                    tag, data, data_count);
+        }
+        if (res == OK && mIndexValid) {
+            IndexEntry newEntry = {tag, static_cast<uint32_t>(
+                    get_camera_metadata_entry_count(mBuffer) - 1)};
+            auto it = std::lower_bound(mIndex.begin(), mIndex.end(),
+                    newEntry);
+            mIndex.insert(it, newEntry);
+        }
     }
 
     if (res != OK) {
@@ -350,7 +370,7 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
 
 bool CameraMetadata::exists(uint32_t tag) const {
     camera_metadata_ro_entry entry;
-    return find_camera_metadata_ro_entry(mBuffer, tag, &entry) == 0;
+    return findEntry(tag, &entry) == 0;
 }
 
 camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
@@ -361,7 +381,7 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
         entry.count = 0;
         return entry;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    res = findEntry(tag, &entry);
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -372,7 +392,7 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
 camera_metadata_ro_entry_t CameraMetadata::find(uint32_t tag) const {
     status_t res;
     camera_metadata_ro_entry entry;
-    res = find_camera_metadata_ro_entry(mBuffer, tag, &entry);
+    res = findEntry(tag, &entry);
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -387,7 +407,7 @@ status_t CameraMetadata::erase(uint32_t tag) {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    res = findEntry(tag, &entry);
     if (res == NAME_NOT_FOUND) {
         return OK;
     } else if (res != OK) {
@@ -397,6 +417,8 @@ status_t CameraMetadata::erase(uint32_t tag) {
                 get_camera_metadata_tag_name(tag), tag, strerror(-res), res);
         return res;
     }
+    // Later entries move down, so the index has to be rebuilt
+    invalidateIndex();
     res = delete_camera_metadata_entry(mBuffer, entry.index);
     if (res != OK) {
         ALOGE("%s: Error deleting entry %s.%s (%x): %s %d",
@@ -411,6 +433,75 @@ void CameraMetadata::dump(int fd, int verbosity, int indentation) const {
     dump_indented_camera_metadata(mBuffer, fd, verbosity, indentation);
 }
 
+void CameraMetadata::buildIndex() {
+    size_t count = get_camera_metadata_entry_count(mBuffer);
+    mIndex.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        camera_metadata_ro_entry_t entry;
+        get_camera_metadata_ro_entry(mBuffer, i, &entry);
+        mIndex[i].tag = entry.tag;
+        mIndex[i].index = i;
+    }
+    // Like find_camera_metadata_entry, resolve duplicate tags to their first
+    // entry
+    std::stable_sort(mIndex.begin(), mIndex.end());
+    mIndex.erase(std::unique(mIndex.begin(), mIndex.end(),
+            [](const IndexEntry& a, const IndexEntry& b) {
+                return a.tag == b.tag;
+            }), mIndex.end());
+    mIndexValid = true;
+}
+
+void CameraMetadata::invalidateIndex() {
+    mIndex.clear();
+    mIndexValid = false;
+}
+
+status_t CameraMetadata::findEntry(uint32_t tag,
+        camera_metadata_entry_t *entry) {
+    if (mBuffer == NULL) {
+        return find_camera_metadata_entry(mBuffer, tag, entry);
+    }
+    if (!mIndexValid &&
+            get_camera_metadata_entry_count(mBuffer) >= kMinIndexedEntries) {
+        buildIndex();
+    }
+    if (!mIndexValid) {
+        return find_camera_metadata_entry(mBuffer, tag, entry);
+    }
+
+    IndexEntry key = {tag, 0};
+    auto it = std::lower_bound(mIndex.begin(), mIndex.end(), key);
+    if (it == mIndex.end() || it->tag != tag) {
+        return NAME_NOT_FOUND;
+    }
+    status_t res = get_camera_metadata_entry(mBuffer, it->index, entry);
+    if (CC_UNLIKELY(res != OK || entry->tag != tag)) {
+        ALOGE("%s: Stale index for tag %x", __FUNCTION__, tag);
+        invalidateIndex();
+        return find_camera_metadata_entry(mBuffer, tag, entry);
+    }
+    return OK;
+}
+
+status_t CameraMetadata::findEntry(uint32_t tag,
+        camera_metadata_ro_entry_t *entry) const {
+    if (!mIndexValid) {
+        return find_camera_metadata_ro_entry(mBuffer, tag, entry);
+    }
+
+    IndexEntry key = {tag, 0};
+    auto it = std::lower_bound(mIndex.begin(), mIndex.end(), key);
+    if (it == mIndex.end() || it->tag != tag) {
+        return NAME_NOT_FOUND;
+    }
+    status_t res = get_camera_metadata_ro_entry(mBuffer, it->index, entry);
+    if (CC_UNLIKELY(res != OK || entry->tag != tag)) {
+        return find_camera_metadata_ro_entry(mBuffer, tag, entry);
+    }
+    return OK;
+}
+
 status_t CameraMetadata::resizeIfNeeded(size_t extraEntries, size_t extraData) {
     if (mBuffer == NULL) {
         mBuffer = allocate_camera_metadata(extraEntries * 2, extraData * 2);
@@ -463,6 +554,9 @@ void CameraMetadata::swap(CameraMetadata& other) {
 
     other.mBuffer = thisBuf;
     mBuffer = otherBuf;
+
+    mIndex.swap(other.mIndex);
+    std::swap(mIndexValid, other.mIndexValid);
 }
 
 status_t CameraMetadata::getTagFromName(const char *name,
@@ -189,22 +189,59 @@ CameraParameters::~CameraParameters()
 {
 }
 
+CameraParameters::ParsedValues::ParsedValues()
+        : previewSize(-1, -1),
+          videoSize(-1, -1),
+          pictureSize(-1, -1),
+          preferredPreviewSizeForVideo(-1, -1),
+          minFps(-1),
+          maxFps(-1)
+{
+}
+
+String8 CameraParameters::flatten()
+{
+    if (!mFlattenedValid) {
+        mFlattened = buildFlattened();
+        mFlattenedValid = true;
+    }
+    return mFlattened;
+}
+
 String8 CameraParameters::flatten() const
 {
-    String8 flattened("");
-    size_t size = mMap.size();
+    if (mFlattenedValid) {
+        return mFlattened;
+    }
+    return buildFlattened();
+}
 
+String8 CameraParameters::buildFlattened() const
+{
+    // Size the string up front so it is built without reallocating
+    size_t size = mMap.size();
+    size_t length = 0;
     for (size_t i = 0; i < size; i++) {
-        String8 k, v;
-        k = mMap.keyAt(i);
-        v = mMap.valueAt(i);
+        length += mMap.keyAt(i).length() + 1 + mMap.valueAt(i).length();
+        if (i != size-1)
+            length++;
+    }
 
-        flattened += k;
-        flattened += "=";
-        flattened += v;
+    String8 flattened("");
+    char *p = flattened.lockBuffer(length);
+    for (size_t i = 0; i < size; i++) {
+        const String8 &k = mMap.keyAt(i);
+        const String8 &v = mMap.valueAt(i);
+
+        memcpy(p, k.string(), k.length());
+        p += k.length();
+        *p++ = '=';
+        memcpy(p, v.string(), v.length());
+        p += v.length();
         if (i != size-1)
-            flattened += ";";
+            *p++ = ';';
     }
+    flattened.unlockBuffer(length);
 
     return flattened;
 }
@@ -215,6 +252,8 @@ void CameraParameters::unflatten(const String8 &params)
     const char *b;
 
     mMap.clear();
+    mParsed = ParsedValues();
+    mFlattenedValid = false;
 
     for (;;) {
         // Find the bounds of the key name.
@@ -239,6 +278,22 @@ void CameraParameters::unflatten(const String8 &params)
         mMap.add(k, v);
         a = b+1;
     }
+
+    static const char *const parsedKeys[] = {
+        KEY_PREVIEW_SIZE,
+        KEY_VIDEO_SIZE,
+        KEY_PICTURE_SIZE,
+        KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO,
+        KEY_PREVIEW_FPS_RANGE,
+        KEY_SUPPORTED_PREVIEW_SIZES,
+        KEY_SUPPORTED_VIDEO_SIZES,
+        KEY_SUPPORTED_PICTURE_SIZES,
+    };
+    for (const char *key : parsedKeys) {
+        const char *value = get(key);
+        if (value != 0)
+            parseValue(key, value);
+    }
 }
 
 
@@ -256,6 +311,8 @@ void CameraParameters::set(const char *key, const char *value)
     }
 
     mMap.replaceValueFor(String8(key), String8(value));
+    mFlattenedValid = false;
+    parseValue(key, value);
 }
 
 void CameraParameters::set(const char *key, int value)
@@ -298,6 +355,8 @@ float CameraParameters::getFloat(const char *key) const
 void CameraParameters::remove(const char *key)
 {
     mMap.removeItem(String8(key));
+    mFlattenedValid = false;
+    parseValue(key, 0);
 }
 
 // Parse string like "640x480" or "10000,20000"
@@ -351,6 +410,43 @@ static void parseSizesList(const char *sizesStr, Vector<Size> &sizes)
     }
 }
 
+static void parseSize(const char *str, Size *size)
+{
+    size->width = size->height = -1;
+    // Like get(), treat empty values as missing
+    if (str == 0 || *str == '\0') return;
+    parse_pair(str, &size->width, &size->height, 'x');
+}
+
+void CameraParameters::parseValue(const char *key, const char *value)
+{
+    if (strcmp(key, KEY_PREVIEW_SIZE) == 0) {
+        parseSize(value, &mParsed.previewSize);
+    } else if (strcmp(key, KEY_VIDEO_SIZE) == 0) {
+        parseSize(value, &mParsed.videoSize);
+    } else if (strcmp(key, KEY_PICTURE_SIZE) == 0) {
+        parseSize(value, &mParsed.pictureSize);
+    } else if (strcmp(key, KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO) == 0) {
+        parseSize(value, &mParsed.preferredPreviewSizeForVideo);
+    } else if (strcmp(key, KEY_PREVIEW_FPS_RANGE) == 0) {
+        mParsed.minFps = mParsed.maxFps = -1;
+        if (value != 0 && *value != '\0')
+            parse_pair(value, &mParsed.minFps, &mParsed.maxFps, ',');
+    } else if (strcmp(key, KEY_SUPPORTED_PREVIEW_SIZES) == 0) {
+        mParsed.supportedPreviewSizes.clear();
+        if (value != 0 && *value != '\0')
+            parseSizesList(value, mParsed.supportedPreviewSizes);
+    } else if (strcmp(key, KEY_SUPPORTED_VIDEO_SIZES) == 0) {
+        mParsed.supportedVideoSizes.clear();
+        if (value != 0 && *value != '\0')
+            parseSizesList(value, mParsed.supportedVideoSizes);
+    } else if (strcmp(key, KEY_SUPPORTED_PICTURE_SIZES) == 0) {
+        mParsed.supportedPictureSizes.clear();
+        if (value != 0 && *value != '\0')
+            parseSizesList(value, mParsed.supportedPictureSizes);
+    }
+}
+
 void CameraParameters::setPreviewSize(int width, int height)
 {
     char str[32];
@@ -360,25 +456,20 @@ void CameraParameters::setPreviewSize(int width, int height)
 
 void CameraParameters::getPreviewSize(int *width, int *height) const
 {
-    *width = *height = -1;
-    // Get the current string, if it doesn't exist, leave the -1x-1
-    const char *p = get(KEY_PREVIEW_SIZE);
-    if (p == 0)  return;
-    parse_pair(p, width, height, 'x');
+    // -1x-1 if the size is not set
+    *width = mParsed.previewSize.width;
+    *height = mParsed.previewSize.height;
 }
 
 void CameraParameters::getPreferredPreviewSizeForVideo(int *width, int *height) const
 {
-    *width = *height = -1;
-    const char *p = get(KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO);
-    if (p == 0)  return;
-    parse_pair(p, width, height, 'x');
+    *width = mParsed.preferredPreviewSizeForVideo.width;
+    *height = mParsed.preferredPreviewSizeForVideo.height;
 }
 
 void CameraParameters::getSupportedPreviewSizes(Vector<Size> &sizes) const
 {
-    const char *previewSizesStr = get(KEY_SUPPORTED_PREVIEW_SIZES);
-    parseSizesList(previewSizesStr, sizes);
+    sizes.appendVector(mParsed.supportedPreviewSizes);
 }
 
 void CameraParameters::setVideoSize(int width, int height)
@@ -390,16 +481,13 @@ void CameraParameters::setVideoSize(int width, int height)
 
 void CameraParameters::getVideoSize(int *width, int *height) const
 {
-    *width = *height = -1;
-    const char *p = get(KEY_VIDEO_SIZE);
-    if (p == 0) return;
-    parse_pair(p, width, height, 'x');
+    *width = mParsed.videoSize.width;
+    *height = mParsed.videoSize.height;
 }
 
 void CameraParameters::getSupportedVideoSizes(Vector<Size> &sizes) const
 {
-    const char *videoSizesStr = get(KEY_SUPPORTED_VIDEO_SIZES);
-    parseSizesList(videoSizesStr, sizes);
+    sizes.appendVector(mParsed.supportedVideoSizes);
 }
 
 void CameraParameters::setPreviewFrameRate(int fps)
@@ -414,10 +502,8 @@ int CameraParameters::getPreviewFrameRate() const
 
 void CameraParameters::getPreviewFpsRange(int *min_fps, int *max_fps) const
 {
-    *min_fps = *max_fps = -1;
-    const char *p = get(KEY_PREVIEW_FPS_RANGE);
-    if (p == 0) return;
-    parse_pair(p, min_fps, max_fps, ',');
+    *min_fps = mParsed.minFps;
+    *max_fps = mParsed.maxFps;
 }
 
 void CameraParameters::setPreviewFormat(const char *format)
@@ -439,17 +525,14 @@ void CameraParameters::setPictureSize(int width, int height)
 
 void CameraParameters::getPictureSize(int *width, int *height) const
 {
-    *width = *height = -1;
-    // Get the current string, if it doesn't exist, leave the -1x-1
-    const char *p = get(KEY_PICTURE_SIZE);
-    if (p == 0) return;
-    parse_pair(p, width, height, 'x');
+    // -1x-1 if the size is not set
+    *width = mParsed.pictureSize.width;
+    *height = mParsed.pictureSize.height;
 }
 
 void CameraParameters::getSupportedPictureSizes(Vector<Size> &sizes) const
 {
-    const char *pictureSizesStr = get(KEY_SUPPORTED_PICTURE_SIZES);
-    parseSizesList(pictureSizesStr, sizes);
+    sizes.appendVector(mParsed.supportedPictureSizes);
 }
 
 void CameraParameters::setPictureFormat(const char *format)
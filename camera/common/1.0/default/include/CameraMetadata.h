@@ -19,6 +19,8 @@
 
 #include "system/camera_metadata.h"
 
+#include <vector>
+
 #include <utils/String8.h>
 #include <utils/Vector.h>
 
@@ -203,6 +205,33 @@ class CameraMetadata {
     camera_metadata_t *mBuffer;
     mutable bool       mLocked;
 
+    /**
+     * Tag -> entry index lookup table, sorted by tag. It is built by non-const
+     * lookups once the buffer holds enough entries for a linear search to
+     * hurt, and kept up to date by updates that add entries. Const methods
+     * only read it, so that they remain safe to call concurrently.
+     */
+    struct IndexEntry {
+        uint32_t tag;
+        uint32_t index;
+
+        bool operator<(const IndexEntry &other) const {
+            return tag < other.tag;
+        }
+    };
+    static const size_t kMinIndexedEntries = 16;
+    std::vector<IndexEntry> mIndex;
+    bool mIndexValid;
+
+    void buildIndex();
+    void invalidateIndex();
+
+    /**
+     * Find an entry, using and building the tag index when worthwhile
+     */
+    status_t findEntry(uint32_t tag, camera_metadata_entry_t *entry);
+    status_t findEntry(uint32_t tag, camera_metadata_ro_entry_t *entry) const;
+
     /**
      * Check if tag has a given type
      */
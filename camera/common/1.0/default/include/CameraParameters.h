@@ -49,6 +49,9 @@ public:
     CameraParameters(const String8 &params) { unflatten(params); }
     ~CameraParameters();
 
+    // The non-const overload keeps the result until the parameters change,
+    // the const one only reuses it and never writes to the object.
+    String8 flatten();
     String8 flatten() const;
     void unflatten(const String8 &params);
 
@@ -696,7 +699,31 @@ public:
     static int previewFormatToEnum(const char* format);
 
 private:
+    // Values of frequently read keys, parsed when they are set instead of
+    // on every get
+    struct ParsedValues {
+        Size previewSize;
+        Size videoSize;
+        Size pictureSize;
+        Size preferredPreviewSizeForVideo;
+        int minFps;
+        int maxFps;
+        Vector<Size> supportedPreviewSizes;
+        Vector<Size> supportedVideoSizes;
+        Vector<Size> supportedPictureSizes;
+
+        ParsedValues();
+    };
+
+    // value is NULL when key has been removed
+    void parseValue(const char *key, const char *value);
+    String8 buildFlattened() const;
+
     DefaultKeyedVector<String8,String8>    mMap;
+    ParsedValues                           mParsed;
+    // Result of flatten(), rebuilt only after the parameters change
+    String8                                mFlattened;
+    bool                                   mFlattenedValid = false;
 };
 
 };
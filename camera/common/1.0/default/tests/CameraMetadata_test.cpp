@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "CameraMetadata.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace common {
+namespace V1_0 {
+namespace helper {
+
+namespace {
+
+// All INT32 tags of the Android sections, so entries of any count can be stored under them
+std::vector<uint32_t> getInt32Tags() {
+    std::vector<uint32_t> tags;
+    for (uint32_t section = 0; section < ANDROID_SECTION_COUNT; section++) {
+        for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                tag < camera_metadata_section_bounds[section][1]; tag++) {
+            if (get_camera_metadata_tag_type(tag) == TYPE_INT32) {
+                tags.push_back(tag);
+            }
+        }
+    }
+    return tags;
+}
+
+void expectContents(const CameraMetadata& metadata, const std::map<uint32_t, int32_t>& expected,
+        const std::vector<uint32_t>& tags) {
+    ASSERT_EQ(expected.size(), metadata.entryCount());
+    for (uint32_t tag : tags) {
+        camera_metadata_ro_entry entry = metadata.find(tag);
+        auto it = expected.find(tag);
+        if (it == expected.end()) {
+            ASSERT_EQ(0u, entry.count) << "tag " << tag;
+            ASSERT_FALSE(metadata.exists(tag)) << "tag " << tag;
+        } else {
+            ASSERT_LT(0u, entry.count) << "tag " << tag;
+            ASSERT_EQ(it->second, entry.data.i32[0]) << "tag " << tag;
+            ASSERT_TRUE(metadata.exists(tag)) << "tag " << tag;
+        }
+    }
+}
+
+TEST(CameraMetadataTest, matchesStdMap) {
+    std::vector<uint32_t> tags = getInt32Tags();
+    ASSERT_LE(32u, tags.size());
+    if (tags.size() > 150) {
+        tags.resize(150);
+    }
+
+    CameraMetadata metadata(1, 8);
+    std::map<uint32_t, int32_t> expected;
+    std::mt19937 rng(20161116);
+
+    // A mix of updates that add or resize entries, erases that shift later entries down, and
+    // sorts that reorder them, checked against a reference map with both find() overloads.
+    for (int i = 0; i < 20000; i++) {
+        uint32_t tag = tags[rng() % tags.size()];
+        uint32_t op = rng() % 10;
+        if (op < 6) {
+            int32_t data[3] = {static_cast<int32_t>(rng()), 0, 0};
+            ASSERT_EQ(OK, metadata.update(tag, data, 1 + rng() % 3));
+            expected[tag] = data[0];
+        } else if (op < 7) {
+            ASSERT_EQ(OK, metadata.erase(tag));
+            expected.erase(tag);
+        } else if (op < 8 && i % 500 == 0) {
+            ASSERT_EQ(OK, metadata.sort());
+        } else {
+            camera_metadata_entry entry = metadata.find(tag);
+            auto it = expected.find(tag);
+            if (it == expected.end()) {
+                ASSERT_EQ(0u, entry.count) << "tag " << tag;
+            } else {
+                ASSERT_LT(0u, entry.count) << "tag " << tag;
+                ASSERT_EQ(it->second, entry.data.i32[0]) << "tag " << tag;
+            }
+        }
+        ASSERT_EQ(expected.size(), metadata.entryCount());
+    }
+    expectContents(metadata, expected, tags);
+
+    CameraMetadata copy(metadata);
+    expectContents(copy, expected, tags);
+
+    CameraMetadata swapped;
+    swapped.swap(metadata);
+    expectContents(swapped, expected, tags);
+    ASSERT_TRUE(metadata.isEmpty());
+}
+
+TEST(CameraMetadataTest, findBenchmark) {
+    std::vector<uint32_t> tags = getInt32Tags();
+    if (tags.size() > 150) {
+        tags.resize(150);
+    }
+    // Insert in reverse so the buffer is unsorted, as metadata filled in by a HAL usually is
+    CameraMetadata metadata;
+    for (auto it = tags.rbegin(); it != tags.rend(); ++it) {
+        int32_t value = *it;
+        ASSERT_EQ(OK, metadata.update(*it, &value, 1));
+    }
+    const int kRounds = 200;
+
+    int64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        for (uint32_t tag : tags) {
+            sum += metadata.find(tag).data.i32[0];
+        }
+    }
+    auto indexedNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    const camera_metadata_t* buffer = metadata.getAndLock();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        for (uint32_t tag : tags) {
+            camera_metadata_ro_entry_t entry;
+            ASSERT_EQ(OK, find_camera_metadata_ro_entry(buffer, tag, &entry));
+            sum -= entry.data.i32[0];
+        }
+    }
+    auto linearNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    metadata.unlock(buffer);
+    ASSERT_EQ(0, sum);
+
+    size_t lookups = kRounds * tags.size();
+    std::cout << "CameraMetadata::find, " << tags.size() << " unsorted entries: indexed "
+              << indexedNanos / lookups << "ns, find_camera_metadata_ro_entry "
+              << linearNanos / lookups << "ns" << std::endl;
+}
+
+}  // namespace anonymous
+
+}  // namespace helper
+}  // namespace V1_0
+}  // namespace common
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "CameraParameters.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace common {
+namespace V1_0 {
+namespace helper {
+
+namespace {
+
+using Params = CameraParameters;
+
+void expectSize(const Size& expected, int width, int height) {
+    EXPECT_EQ(expected.width, width);
+    EXPECT_EQ(expected.height, height);
+}
+
+void expectSizes(const std::vector<Size>& expected, const Vector<Size>& sizes) {
+    ASSERT_EQ(expected.size(), sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++) {
+        EXPECT_EQ(expected[i].width, sizes[i].width) << "size " << i;
+        EXPECT_EQ(expected[i].height, sizes[i].height) << "size " << i;
+    }
+}
+
+// Checks every parsed getter of params against the same getters of a copy parsed from scratch
+void expectSameParsedValues(const CameraParameters& expected, const CameraParameters& params) {
+    int w1, h1, w2, h2;
+    expected.getPreviewSize(&w1, &h1);
+    params.getPreviewSize(&w2, &h2);
+    EXPECT_EQ(w1, w2);
+    EXPECT_EQ(h1, h2);
+    expected.getVideoSize(&w1, &h1);
+    params.getVideoSize(&w2, &h2);
+    EXPECT_EQ(w1, w2);
+    EXPECT_EQ(h1, h2);
+    expected.getPictureSize(&w1, &h1);
+    params.getPictureSize(&w2, &h2);
+    EXPECT_EQ(w1, w2);
+    EXPECT_EQ(h1, h2);
+    expected.getPreferredPreviewSizeForVideo(&w1, &h1);
+    params.getPreferredPreviewSizeForVideo(&w2, &h2);
+    EXPECT_EQ(w1, w2);
+    EXPECT_EQ(h1, h2);
+    expected.getPreviewFpsRange(&w1, &h1);
+    params.getPreviewFpsRange(&w2, &h2);
+    EXPECT_EQ(w1, w2);
+    EXPECT_EQ(h1, h2);
+
+    Vector<Size> sizes1, sizes2;
+    expected.getSupportedPreviewSizes(sizes1);
+    expected.getSupportedVideoSizes(sizes1);
+    expected.getSupportedPictureSizes(sizes1);
+    params.getSupportedPreviewSizes(sizes2);
+    params.getSupportedVideoSizes(sizes2);
+    params.getSupportedPictureSizes(sizes2);
+    ASSERT_EQ(sizes1.size(), sizes2.size());
+    for (size_t i = 0; i < sizes1.size(); i++) {
+        EXPECT_EQ(sizes1[i].width, sizes2[i].width);
+        EXPECT_EQ(sizes1[i].height, sizes2[i].height);
+    }
+}
+
+TEST(CameraParametersTest, parsedGetters) {
+    CameraParameters params;
+    int width, height;
+    params.getPreviewSize(&width, &height);
+    expectSize(Size(-1, -1), width, height);
+
+    params.setPreviewSize(640, 480);
+    params.getPreviewSize(&width, &height);
+    expectSize(Size(640, 480), width, height);
+
+    // Empty values read as missing, unparsable ones leave -1x-1
+    params.set(Params::KEY_PREVIEW_SIZE, "");
+    params.getPreviewSize(&width, &height);
+    expectSize(Size(-1, -1), width, height);
+    params.set(Params::KEY_PICTURE_SIZE, "abc");
+    params.getPictureSize(&width, &height);
+    expectSize(Size(-1, -1), width, height);
+
+    params.set(Params::KEY_PREVIEW_FPS_RANGE, "10000,30000");
+    params.getPreviewFpsRange(&width, &height);
+    expectSize(Size(10000, 30000), width, height);
+    params.remove(Params::KEY_PREVIEW_FPS_RANGE);
+    params.getPreviewFpsRange(&width, &height);
+    expectSize(Size(-1, -1), width, height);
+
+    // Sizes lists keep the sizes before an invalid one, and getters append to their argument
+    params.set(Params::KEY_SUPPORTED_VIDEO_SIZES, "1920x1080,1280x720");
+    params.set(Params::KEY_SUPPORTED_PICTURE_SIZES, "4000x3000,12,640x480");
+    Vector<Size> sizes;
+    params.getSupportedVideoSizes(sizes);
+    params.getSupportedPictureSizes(sizes);
+    expectSizes({Size(1920, 1080), Size(1280, 720), Size(4000, 3000)}, sizes);
+
+    CameraParameters unflattened(params.flatten());
+    expectSameParsedValues(params, unflattened);
+}
+
+TEST(CameraParametersTest, flattenAfterChanges) {
+    CameraParameters params;
+    EXPECT_STREQ("", params.flatten().string());
+
+    params.set("b", "2");
+    params.set("a", "1");
+    EXPECT_STREQ("a=1;b=2", params.flatten().string());
+    params.set("c", "");
+    EXPECT_STREQ("a=1;b=2;c=", params.flatten().string());
+    params.set("a", 7);
+    EXPECT_STREQ("a=7;b=2;c=", params.flatten().string());
+    // Rejected values leave the parameters unchanged
+    params.set("b", "1;2");
+    EXPECT_STREQ("a=7;b=2;c=", params.flatten().string());
+    params.remove("c");
+    EXPECT_STREQ("a=7;b=2", params.flatten().string());
+    const CameraParameters& constParams = params;
+    EXPECT_STREQ("a=7;b=2", constParams.flatten().string());
+
+    params.unflatten(String8("x=1;y=2"));
+    EXPECT_STREQ("x=1;y=2", params.flatten().string());
+    EXPECT_EQ(nullptr, params.get("a"));
+
+    CameraParameters copy(params);
+    copy.set("z", "3");
+    EXPECT_STREQ("x=1;y=2;z=3", copy.flatten().string());
+    EXPECT_STREQ("x=1;y=2", params.flatten().string());
+}
+
+TEST(CameraParametersTest, matchesReference) {
+    static const char* const kKeys[] = {
+        Params::KEY_PREVIEW_SIZE, Params::KEY_VIDEO_SIZE, Params::KEY_PICTURE_SIZE,
+        Params::KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO, Params::KEY_PREVIEW_FPS_RANGE,
+        Params::KEY_SUPPORTED_PREVIEW_SIZES, Params::KEY_SUPPORTED_VIDEO_SIZES,
+        Params::KEY_SUPPORTED_PICTURE_SIZES, Params::KEY_ZOOM, "vendor-1", "vendor-2", "vendor-3",
+    };
+    static const char* const kValues[] = {
+        "640x480", "1920x1080", "", "abc", "10000,30000", "640x480,320x240", "1x2,3", "15",
+        "4000x3000,1920x1080,1280x720", "x",
+    };
+    const size_t kNumKeys = sizeof(kKeys) / sizeof(kKeys[0]);
+    const size_t kNumValues = sizeof(kValues) / sizeof(kValues[0]);
+
+    CameraParameters params;
+    std::map<std::string, std::string> expected;
+    std::mt19937 rng(20161116);
+
+    // Random sets, removes and flatten round trips; after each step the cached parsed values and
+    // flattened string have to match parameters parsed from scratch and a reference map.
+    for (int i = 0; i < 20000; i++) {
+        const char* key = kKeys[rng() % kNumKeys];
+        uint32_t op = rng() % 8;
+        if (op < 4) {
+            const char* value = kValues[rng() % kNumValues];
+            params.set(key, value);
+            expected[key] = value;
+        } else if (op == 4) {
+            params.remove(key);
+            expected.erase(key);
+        } else if (op == 5) {
+            params.unflatten(params.flatten());
+        }
+
+        std::string flattened;
+        for (const auto& entry : expected) {
+            if (!flattened.empty()) {
+                flattened += ";";
+            }
+            flattened += entry.first + "=" + entry.second;
+        }
+        ASSERT_EQ(flattened, params.flatten().string());
+        const CameraParameters& constParams = params;
+        ASSERT_EQ(flattened, constParams.flatten().string());
+
+        CameraParameters reparsed(String8(flattened.c_str()));
+        expectSameParsedValues(reparsed, params);
+        if (::testing::Test::HasFailure()) {
+            FAIL() << "after step " << i << ": " << flattened;
+        }
+    }
+}
+
+TEST(CameraParametersTest, readBenchmark) {
+    CameraParameters params;
+    for (int i = 0; i < 150; i++) {
+        char key[32], value[64];
+        snprintf(key, sizeof(key), "vendor-key-%d", i);
+        snprintf(value, sizeof(value), "value-%d,%d,%d", i, i * 2, i * 3);
+        params.set(key, value);
+    }
+    params.set(Params::KEY_SUPPORTED_PREVIEW_SIZES,
+            "1920x1080,1280x720,960x720,800x600,720x480,640x480,352x288,320x240,176x144");
+    params.setPreviewSize(640, 480);
+    const int kRounds = 10000;
+
+    // Reads of unchanged parameters, as a HAL polls them between reconfigurations
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        int width, height;
+        params.getPreviewSize(&width, &height);
+        Vector<Size> sizes;
+        params.getSupportedPreviewSizes(sizes);
+        total += params.flatten().length() + sizes.size() + width;
+    }
+    auto unchangedNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    // The same reads after every change of a parameter, which rebuild the flattened string
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        params.set(Params::KEY_ZOOM, i);
+        int width, height;
+        params.getPreviewSize(&width, &height);
+        Vector<Size> sizes;
+        params.getSupportedPreviewSizes(sizes);
+        total += params.flatten().length() + sizes.size() + width;
+    }
+    auto changedNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    ASSERT_LT(0u, total);
+
+    std::cout << "CameraParameters preview size + sizes + flatten, 152 keys: unchanged "
+              << unchangedNanos / kRounds << "ns, after set() " << changedNanos / kRounds << "ns"
+              << std::endl;
+}
+
+}  // namespace anonymous
+
+}  // namespace helper
+}  // namespace V1_0
+}  // namespace common
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
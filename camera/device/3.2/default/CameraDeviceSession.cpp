@@ -17,6 +17,8 @@
 #define LOG_TAG "CamDevSession@3.2-impl"
 #include <android/log.h>
 
+#include <algorithm>
+#include <inttypes.h>
 #include <set>
 #include <utils/Trace.h>
 #include <hardware/gralloc.h>
@@ -34,6 +36,9 @@ namespace implementation {
 static constexpr size_t CAMERA_REQUEST_METADATA_QUEUE_SIZE = 1 << 20 /* 1MB */;
 // Size of result metadata fast message queue. Change to 0 to always use hwbinder buffer.
 static constexpr size_t CAMERA_RESULT_METADATA_QUEUE_SIZE  = 1 << 20 /* 1MB */;
+// Maximum size of metadata sent over hwbinder in one coalesced processCaptureResult call, which
+// keeps the call well below the hwbinder transaction limit
+static constexpr size_t MAX_COALESCED_RESULT_METADATA_SIZE = 256 * 1024 /* 256KB */;
 
 HandleImporter CameraDeviceSession::sHandleImporter;
 const int CameraDeviceSession::ResultBatcher::NOT_BATCHED;
@@ -144,6 +149,7 @@ void CameraDeviceSession::dumpState(const native_handle_t* fd) {
     if (!isClosed()) {
         mDevice->ops->dump(mDevice, fd->data[0]);
     }
+    mResultBatcher.dump(fd->data[0]);
 }
 
 /**
@@ -202,56 +208,110 @@ bool CameraDeviceSession::handleAePrecaptureCancelRequestLocked(
  */
 void CameraDeviceSession::overrideResultForPrecaptureCancelLocked(
         const AETriggerCancelOverride &aeTriggerCancelOverride,
-        ::android::hardware::camera::common::V1_0::helper::CameraMetadata *settings /*out*/) {
+        ResultOverride *resultOverride /*out*/) {
     if (aeTriggerCancelOverride.applyAeLock) {
         // Only devices <= v3.2 should have this override
         assert(mDeviceVersion <= CAMERA_DEVICE_API_VERSION_3_2);
-        settings->update(ANDROID_CONTROL_AE_LOCK, &aeTriggerCancelOverride.aeLock, 1);
+        resultOverride->add(ANDROID_CONTROL_AE_LOCK, aeTriggerCancelOverride.aeLock);
     }
 
     if (aeTriggerCancelOverride.applyAePrecaptureTrigger) {
         // Only devices <= v3.2 should have this override
         assert(mDeviceVersion <= CAMERA_DEVICE_API_VERSION_3_2);
-        settings->update(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER,
-                &aeTriggerCancelOverride.aePrecaptureTrigger, 1);
+        resultOverride->add(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER,
+                aeTriggerCancelOverride.aePrecaptureTrigger);
+    }
+}
+
+void CameraDeviceSession::ResultOverride::add(uint32_t tag, int32_t value) {
+    for (size_t i = 0; i < numEntries; i++) {
+        if (entries[i].tag == tag) {
+            entries[i].value = value;
+            return;
+        }
+    }
+    if (numEntries == kMaxEntries) {
+        ALOGE("%s: too many overrides, dropping tag 0x%x", __FUNCTION__, tag);
+        return;
     }
+    entries[numEntries].tag = tag;
+    entries[numEntries].value = value;
+    numEntries++;
+}
+
+size_t CameraDeviceSession::getOverriddenMetadataCapacity(
+        const camera_metadata_t* src, const ResultOverride& resultOverride,
+        size_t* entryCapacity, size_t* dataCapacity) {
+    *entryCapacity = get_camera_metadata_entry_count(src);
+    *dataCapacity = get_camera_metadata_data_count(src);
+    for (size_t i = 0; i < resultOverride.numEntries; i++) {
+        camera_metadata_ro_entry entry;
+        if (find_camera_metadata_ro_entry(src, resultOverride.entries[i].tag, &entry) != OK) {
+            int type = get_camera_metadata_tag_type(resultOverride.entries[i].tag);
+            *entryCapacity += 1;
+            *dataCapacity += calculate_camera_metadata_entry_data_size(type, 1);
+        }
+    }
+    return calculate_camera_metadata_size(*entryCapacity, *dataCapacity);
+}
+
+bool CameraDeviceSession::writeOverriddenMetadata(
+        const camera_metadata_t* src, const ResultOverride& resultOverride,
+        uint8_t* dst, size_t dstSize) {
+    size_t entryCapacity, dataCapacity;
+    if (getOverriddenMetadataCapacity(src, resultOverride, &entryCapacity, &dataCapacity) !=
+            dstSize) {
+        return false;
+    }
+    camera_metadata_t* metadata = place_camera_metadata(dst, dstSize, entryCapacity, dataCapacity);
+    if (metadata == nullptr || append_camera_metadata(metadata, src) != OK) {
+        return false;
+    }
+
+    // Entries which are already there are patched in place, and the new ones use the capacity
+    // reserved for them, so the metadata is never resized
+    for (size_t i = 0; i < resultOverride.numEntries; i++) {
+        uint32_t tag = resultOverride.entries[i].tag;
+        int32_t value = resultOverride.entries[i].value;
+        uint8_t byteValue = static_cast<uint8_t>(value);
+        const void* data = (get_camera_metadata_tag_type(tag) == TYPE_BYTE) ?
+                static_cast<const void*>(&byteValue) : static_cast<const void*>(&value);
+
+        camera_metadata_entry entry;
+        int res;
+        if (find_camera_metadata_entry(metadata, tag, &entry) == OK) {
+            res = update_camera_metadata_entry(metadata, entry.index, data, 1, nullptr);
+        } else {
+            res = add_camera_metadata_entry(metadata, tag, data, 1);
+        }
+        if (res != OK) {
+            ALOGE("%s: cannot override tag 0x%x", __FUNCTION__, tag);
+            return false;
+        }
+    }
+    return true;
 }
 
 Status CameraDeviceSession::importRequest(
         const CaptureRequest& request,
-        hidl_vec<buffer_handle_t*>& allBufPtrs,
-        hidl_vec<int>& allFences) {
+        std::vector<buffer_handle_t*>& allBufPtrs,
+        std::vector<int>& allFences) {
     bool hasInputBuf = (request.inputBuffer.streamId != -1 &&
             request.inputBuffer.bufferId != 0);
     size_t numOutputBufs = request.outputBuffers.size();
     size_t numBufs = numOutputBufs + (hasInputBuf ? 1 : 0);
-    // Validate all I/O buffers
-    hidl_vec<buffer_handle_t> allBufs;
-    hidl_vec<uint64_t> allBufIds;
-    allBufs.resize(numBufs);
-    allBufIds.resize(numBufs);
     allBufPtrs.resize(numBufs);
     allFences.resize(numBufs);
-    std::vector<int32_t> streamIds(numBufs);
-
-    for (size_t i = 0; i < numOutputBufs; i++) {
-        allBufs[i] = request.outputBuffers[i].buffer.getNativeHandle();
-        allBufIds[i] = request.outputBuffers[i].bufferId;
-        allBufPtrs[i] = &allBufs[i];
-        streamIds[i] = request.outputBuffers[i].streamId;
-    }
-    if (hasInputBuf) {
-        allBufs[numOutputBufs] = request.inputBuffer.buffer.getNativeHandle();
-        allBufIds[numOutputBufs] = request.inputBuffer.bufferId;
-        allBufPtrs[numOutputBufs] = &allBufs[numOutputBufs];
-        streamIds[numOutputBufs] = request.inputBuffer.streamId;
-    }
 
+    // Validate all I/O buffers
     for (size_t i = 0; i < numBufs; i++) {
-        buffer_handle_t buf = allBufs[i];
-        uint64_t bufId = allBufIds[i];
-        CirculatingBuffers& cbs = mCirculatingBuffers[streamIds[i]];
-        if (cbs.count(bufId) == 0) {
+        const StreamBuffer& streamBuf = (i < numOutputBufs) ?
+                request.outputBuffers[i] : request.inputBuffer;
+        uint64_t bufId = streamBuf.bufferId;
+        CirculatingBuffers& cbs = mCirculatingBuffers[streamBuf.streamId];
+        auto it = cbs.find(bufId);
+        if (it == cbs.end()) {
+            buffer_handle_t buf = streamBuf.buffer.getNativeHandle();
             if (buf == nullptr) {
                 ALOGE("%s: bufferId %" PRIu64 " has null buffer handle!", __FUNCTION__, bufId);
                 return Status::ILLEGAL_ARGUMENT;
@@ -262,11 +322,12 @@ Status CameraDeviceSession::importRequest(
             if (importedBuf == nullptr) {
                 ALOGE("%s: output buffer %zu is invalid!", __FUNCTION__, i);
                 return Status::INTERNAL_ERROR;
-            } else {
-                cbs[bufId] = importedBuf;
             }
+            it = cbs.emplace(bufId, importedBuf).first;
         }
-        allBufPtrs[i] = &cbs[bufId];
+        // Elements of an unordered_map are not moved by rehashing, so the pointer stays valid
+        // until the buffer is removed from the cache
+        allBufPtrs[i] = &it->second;
     }
 
     // All buffers are imported. Now validate output buffer acquire fences
@@ -292,14 +353,20 @@ Status CameraDeviceSession::importRequest(
 }
 
 void CameraDeviceSession::cleanupInflightFences(
-        hidl_vec<int>& allFences, size_t numFences) {
+        std::vector<int>& allFences, size_t numFences) {
     for (size_t j = 0; j < numFences; j++) {
         sHandleImporter.closeFence(allFences[j]);
     }
 }
 
 CameraDeviceSession::ResultBatcher::ResultBatcher(
-        const sp<ICameraDeviceCallback>& callback) : mCallback(callback) {};
+        const sp<ICameraDeviceCallback>& callback) : mCallback(callback) {
+    mDispatchThread = std::thread(&ResultBatcher::dispatchLoop, this);
+}
+
+CameraDeviceSession::ResultBatcher::~ResultBatcher() {
+    stopDispatch();
+}
 
 bool CameraDeviceSession::ResultBatcher::InflightBatch::allDelivered() const {
     if (!mShutterDelivered) return false;
@@ -394,7 +461,7 @@ void CameraDeviceSession::ResultBatcher::sendBatchShutterCbsLocked(
         return;
     }
 
-    mCallback->notify(batch->mShutterMsgs);
+    queueNotifyMsgs(batch->mShutterMsgs);
     batch->mShutterDelivered = true;
     batch->mShutterMsgs.clear();
 }
@@ -510,8 +577,7 @@ void CameraDeviceSession::ResultBatcher::sendBatchBuffersLocked(
             moveStreamBuffer(std::move(outBufs[j]), results[i].outputBuffers[j]);
         }
     }
-    invokeProcessCaptureResultCallback(results, /* tryWriteFmq */false);
-    freeReleaseFences(results);
+    queueCaptureResults(results, /* tryWriteFmq */false);
     for (int streamId : streams) {
         auto it = batch->mBatchBufs.find(streamId);
         if (it == batch->mBatchBufs.end()) {
@@ -556,7 +622,7 @@ void CameraDeviceSession::ResultBatcher::sendBatchMetadataLocked(
     }
     hidl_vec<CaptureResult> hResults;
     hResults.setToExternal(results.data(), results.size());
-    invokeProcessCaptureResultCallback(hResults, /* tryWriteFmq */true);
+    queueCaptureResults(hResults, /* tryWriteFmq */true);
     batch->mPartialResultProgress = lastPartialResultIdx;
     for (uint32_t partialIdx : toBeRemovedIdxes) {
         batch->mResultMds.erase(partialIdx);
@@ -564,7 +630,7 @@ void CameraDeviceSession::ResultBatcher::sendBatchMetadataLocked(
 }
 
 void CameraDeviceSession::ResultBatcher::notifySingleMsg(NotifyMsg& msg) {
-    mCallback->notify({msg});
+    queueNotifyMsgs({msg});
     return;
 }
 
@@ -629,47 +695,281 @@ void CameraDeviceSession::ResultBatcher::notify(NotifyMsg& msg) {
     }
 }
 
-void CameraDeviceSession::ResultBatcher::invokeProcessCaptureResultCallback(
+void CameraDeviceSession::ResultBatcher::queueCaptureResults(
         hidl_vec<CaptureResult> &results, bool tryWriteFmq) {
-    if (mProcessCaptureResultLock.tryLock() != OK) {
-        ALOGV("%s: previous call is not finished! waiting 1s...", __FUNCTION__);
-        if (mProcessCaptureResultLock.timedLock(1000000000 /* 1s */) != OK) {
-            ALOGE("%s: cannot acquire lock in 1s, cannot proceed",
-                    __FUNCTION__);
-            return;
+    nsecs_t now = systemTime();
+    Mutex::Autolock _l(mDispatchLock);
+    if (mDispatchStopped) {
+        ALOGE("%s: result dispatch is stopped, dropping %zu results", __FUNCTION__,
+                results.size());
+        freeReleaseFences(results);
+        return;
+    }
+
+    for (CaptureResult &result : results) {
+        queueCaptureResultLocked(result, tryWriteFmq, ResultOverride(), now);
+    }
+    mPendingCond.signal();
+}
+
+void CameraDeviceSession::ResultBatcher::queueCaptureResultLocked(CaptureResult& result,
+        bool tryWriteFmq, const ResultOverride& resultOverride, nsecs_t queuedTime) {
+    if (result.result.size() > 0) {
+        size_t fmqResultSize = 0;
+        if (tryWriteFmq) {
+            fmqResultSize = writeResultMetadataLocked(result.result, resultOverride);
+            if (fmqResultSize == 0 && mResultMetadataQueue->availableToWrite() > 0) {
+                ALOGW("%s: couldn't utilize fmq, fall back to hwbinder", __FUNCTION__);
+            }
+        }
+        if (fmqResultSize > 0) {
+            result.fmqResultSize = fmqResultSize;
+            result.result.resize(0);
+        } else {
+            // The metadata might point into HAL memory that is only valid until the HAL
+            // callback returns
+            result.fmqResultSize = 0;
+            result.result = copyResultMetadata(result.result, resultOverride);
+        }
+        mMetadataStats.mNumResults++;
+        mMetadataStats.mBytesCopied += (fmqResultSize > 0) ?
+                fmqResultSize : result.result.size();
+    }
+    mPending.emplace_back();
+    PendingCallback& pending = mPending.back();
+    pending.mIsResult = true;
+    pending.mResult = std::move(result);
+    pending.mQueuedTime = queuedTime;
+}
+
+size_t CameraDeviceSession::ResultBatcher::writeResultMetadataLocked(
+        const hidl_vec<uint8_t>& metadata, const ResultOverride& resultOverride) {
+    const camera_metadata_t* src = reinterpret_cast<const camera_metadata_t*>(metadata.data());
+    size_t entryCapacity, dataCapacity;
+    size_t size = resultOverride.empty() ? metadata.size() :
+            getOverriddenMetadataCapacity(src, resultOverride, &entryCapacity, &dataCapacity);
+
+    ResultMetadataQueue::MemTransaction tx;
+    if (!mResultMetadataQueue->beginWrite(size, &tx)) {
+        return 0;
+    }
+    const auto& first = tx.getFirstRegion();
+    const auto& second = tx.getSecondRegion();
+    size_t firstLength = std::min(first.getLength(), size);
+
+    if (resultOverride.empty()) {
+        std::copy_n(metadata.data(), firstLength, first.getAddress());
+        std::copy_n(metadata.data() + firstLength, size - firstLength, second.getAddress());
+    } else if (firstLength == size &&
+            reinterpret_cast<uintptr_t>(first.getAddress()) % alignof(uint64_t) == 0) {
+        // Build the overridden metadata right in the queue
+        if (!writeOverriddenMetadata(src, resultOverride, first.getAddress(), size)) {
+            return 0;
+        }
+    } else {
+        // The reserved space wraps around or is not suitably aligned for camera_metadata_t, so
+        // the metadata has to be built aside first
+        mOverrideBuffer.resize(size);
+        if (!writeOverriddenMetadata(src, resultOverride, mOverrideBuffer.data(), size)) {
+            return 0;
         }
+        std::copy_n(mOverrideBuffer.data(), firstLength, first.getAddress());
+        std::copy_n(mOverrideBuffer.data() + firstLength, size - firstLength,
+                second.getAddress());
     }
-    if (tryWriteFmq && mResultMetadataQueue->availableToWrite() > 0) {
-        for (CaptureResult &result : results) {
-            if (result.result.size() > 0) {
-                if (mResultMetadataQueue->write(result.result.data(), result.result.size())) {
-                    result.fmqResultSize = result.result.size();
-                    result.result.resize(0);
-                } else {
-                    ALOGW("%s: couldn't utilize fmq, fall back to hwbinder", __FUNCTION__);
-                    result.fmqResultSize = 0;
+
+    if (!mResultMetadataQueue->commitWrite(size)) {
+        return 0;
+    }
+    return size;
+}
+
+hidl_vec<uint8_t> CameraDeviceSession::ResultBatcher::copyResultMetadata(
+        const hidl_vec<uint8_t>& metadata, const ResultOverride& resultOverride) {
+    if (resultOverride.empty()) {
+        return hidl_vec<uint8_t>(metadata);
+    }
+
+    const camera_metadata_t* src = reinterpret_cast<const camera_metadata_t*>(metadata.data());
+    size_t entryCapacity, dataCapacity;
+    size_t size = getOverriddenMetadataCapacity(src, resultOverride, &entryCapacity,
+            &dataCapacity);
+    hidl_vec<uint8_t> copy;
+    copy.resize(size);
+    if (!writeOverriddenMetadata(src, resultOverride, copy.data(), size)) {
+        ALOGE("%s: cannot apply result overrides, sending metadata as is", __FUNCTION__);
+        return hidl_vec<uint8_t>(metadata);
+    }
+    return copy;
+}
+
+void CameraDeviceSession::ResultBatcher::queueNotifyMsgs(const std::vector<NotifyMsg>& msgs) {
+    nsecs_t now = systemTime();
+    Mutex::Autolock _l(mDispatchLock);
+    if (mDispatchStopped) {
+        ALOGE("%s: result dispatch is stopped, dropping %zu notifications", __FUNCTION__,
+                msgs.size());
+        return;
+    }
+
+    for (const NotifyMsg& msg : msgs) {
+        mPending.emplace_back();
+        PendingCallback& pending = mPending.back();
+        pending.mIsResult = false;
+        pending.mMsg = msg;
+        pending.mQueuedTime = now;
+    }
+    mPendingCond.signal();
+}
+
+void CameraDeviceSession::ResultBatcher::dispatchLoop() {
+    std::deque<PendingCallback> pending;
+    DispatchStats stats;
+
+    Mutex::Autolock _l(mDispatchLock);
+    while (true) {
+        while (mPending.empty() && !mDispatchStopped) {
+            mPendingCond.wait(mDispatchLock);
+        }
+        if (mPending.empty()) {
+            // stopped, and everything has been sent
+            break;
+        }
+
+        pending.swap(mPending);
+        mDispatching = true;
+        mDispatchLock.unlock();
+
+        dispatchPending(pending, &stats);
+
+        mDispatchLock.lock();
+        mDispatching = false;
+        mDispatchStats = stats;
+        mDrainedCond.broadcast();
+    }
+}
+
+void CameraDeviceSession::ResultBatcher::dispatchPending(
+        std::deque<PendingCallback>& pending, DispatchStats* stats) {
+    auto first = pending.begin();
+    while (first != pending.end()) {
+        // find the run of callbacks sent by this call
+        auto last = first;
+        size_t metadataSize = 0;
+        while (last != pending.end() && last->mIsResult == first->mIsResult) {
+            if (last->mIsResult) {
+                metadataSize += last->mResult.result.size();
+                if (last != first && metadataSize > MAX_COALESCED_RESULT_METADATA_SIZE) {
+                    break;
                 }
             }
+            ++last;
+        }
+        size_t count = last - first;
+
+        nsecs_t now = systemTime();
+        for (auto it = first; it != last; ++it) {
+            nsecs_t delay = now - it->mQueuedTime;
+            stats->mTotalQueueDelay += delay;
+            if (delay > stats->mMaxQueueDelay) {
+                stats->mMaxQueueDelay = delay;
+            }
+            uint32_t frameNumber;
+            if (it->mIsResult) {
+                frameNumber = it->mResult.frameNumber;
+            } else if (it->mMsg.type == MsgType::SHUTTER) {
+                frameNumber = it->mMsg.msg.shutter.frameNumber;
+            } else {
+                frameNumber = it->mMsg.msg.error.frameNumber;
+            }
+            ALOGV("%s: frame %u was queued for %" PRId64 " us", __FUNCTION__, frameNumber,
+                    ns2us(delay));
         }
+        stats->mNumCallbacks += count;
+        stats->mNumIpcs++;
+
+        if (first->mIsResult) {
+            hidl_vec<CaptureResult> results;
+            results.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                results[i] = std::move(first[i].mResult);
+            }
+            ATRACE_BEGIN("processCaptureResult");
+            mCallback->processCaptureResult(results);
+            ATRACE_END();
+            freeReleaseFences(results);
+        } else {
+            hidl_vec<NotifyMsg> msgs;
+            msgs.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                msgs[i] = first[i].mMsg;
+            }
+            ATRACE_BEGIN("notify");
+            mCallback->notify(msgs);
+            ATRACE_END();
+        }
+        first = last;
     }
-    mCallback->processCaptureResult(results);
-    mProcessCaptureResultLock.unlock();
+    pending.clear();
 }
 
-void CameraDeviceSession::ResultBatcher::processOneCaptureResult(CaptureResult& result) {
-    hidl_vec<CaptureResult> results;
-    results.resize(1);
-    results[0] = std::move(result);
-    invokeProcessCaptureResultCallback(results, /* tryWriteFmq */true);
-    freeReleaseFences(results);
-    return;
+void CameraDeviceSession::ResultBatcher::waitForDispatch() {
+    Mutex::Autolock _l(mDispatchLock);
+    while (!mPending.empty() || mDispatching) {
+        mDrainedCond.wait(mDispatchLock);
+    }
+}
+
+void CameraDeviceSession::ResultBatcher::stopDispatch() {
+    {
+        Mutex::Autolock _l(mDispatchLock);
+        if (mDispatchStopped) {
+            return;
+        }
+        mDispatchStopped = true;
+        mPendingCond.signal();
+    }
+    mDispatchThread.join();
 }
 
-void CameraDeviceSession::ResultBatcher::processCaptureResult(CaptureResult& result) {
+void CameraDeviceSession::ResultBatcher::dump(int fd) {
+    Mutex::Autolock _l(mDispatchLock);
+    const DispatchStats& stats = mDispatchStats;
+    dprintf(fd, "Result dispatch: %zu pending, %" PRIu64 " callbacks sent in %" PRIu64
+            " calls\n", mPending.size(), stats.mNumCallbacks, stats.mNumIpcs);
+    if (stats.mNumCallbacks > 0) {
+        dprintf(fd, "Result queueing delay: average %" PRId64 " us, max %" PRId64 " us\n",
+                ns2us(stats.mTotalQueueDelay) / static_cast<int64_t>(stats.mNumCallbacks),
+                ns2us(stats.mMaxQueueDelay));
+    }
+    if (mMetadataStats.mNumResults > 0) {
+        dprintf(fd, "Result metadata: %" PRIu64 " bytes copied per result on average\n",
+                mMetadataStats.mBytesCopied / mMetadataStats.mNumResults);
+    }
+}
+
+void CameraDeviceSession::ResultBatcher::processOneCaptureResult(CaptureResult& result,
+        const ResultOverride& resultOverride) {
+    nsecs_t now = systemTime();
+    Mutex::Autolock _l(mDispatchLock);
+    if (mDispatchStopped) {
+        ALOGE("%s: result dispatch is stopped, dropping result of frame %u", __FUNCTION__,
+                result.frameNumber);
+        hidl_vec<CaptureResult> results;
+        results.setToExternal(&result, 1);
+        freeReleaseFences(results);
+        return;
+    }
+    queueCaptureResultLocked(result, /* tryWriteFmq */true, resultOverride, now);
+    mPendingCond.signal();
+}
+
+void CameraDeviceSession::ResultBatcher::processCaptureResult(CaptureResult& result,
+        const ResultOverride& resultOverride) {
     auto pair = getBatch(result.frameNumber);
     int batchIdx = pair.first;
     if (batchIdx == NOT_BATCHED) {
-        processOneCaptureResult(result);
+        processOneCaptureResult(result, resultOverride);
         return;
     }
     std::shared_ptr<InflightBatch> batch = pair.second;
@@ -678,7 +978,7 @@ void CameraDeviceSession::ResultBatcher::processCaptureResult(CaptureResult& res
         // Check if the batch is removed (mostly by notify error) before lock was acquired
         if (batch->mRemoved) {
             // Fall back to non-batch path
-            processOneCaptureResult(result);
+            processOneCaptureResult(result, resultOverride);
             return;
         }
 
@@ -686,7 +986,8 @@ void CameraDeviceSession::ResultBatcher::processCaptureResult(CaptureResult& res
         if (result.result.size() != 0) {
             // Save a copy of metadata
             batch->mResultMds[result.partialResult].mMds.push_back(
-                    std::make_pair(result.frameNumber, result.result));
+                    std::make_pair(result.frameNumber,
+                            copyResultMetadata(result.result, resultOverride)));
         }
 
         // queue buffer
@@ -715,7 +1016,7 @@ void CameraDeviceSession::ResultBatcher::processCaptureResult(CaptureResult& res
             }
             moveStreamBuffer(std::move(result.inputBuffer), nonBatchedResult.inputBuffer);
             nonBatchedResult.partialResult = 0; // 0 for buffer only results
-            processOneCaptureResult(nonBatchedResult);
+            processOneCaptureResult(nonBatchedResult, ResultOverride());
         }
 
         if (result.frameNumber == batch->mLastFrame) {
@@ -812,9 +1113,10 @@ Return<void> CameraDeviceSession::configureStreams(
     // hold the inflight lock for entire configureStreams scope since there must not be any
     // inflight request/results during stream configuration.
     Mutex::Autolock _l(mInflightLock);
-    if (!mInflightBuffers.empty()) {
+    size_t numInflightBuffers = countInflightBuffersLocked();
+    if (numInflightBuffers > 0) {
         ALOGE("%s: trying to configureStreams while there are still %zu inflight buffers!",
-                __FUNCTION__, mInflightBuffers.size());
+                __FUNCTION__, numInflightBuffers);
         _hidl_cb(Status::INTERNAL_ERROR, outStreams);
         return Void();
     }
@@ -940,6 +1242,22 @@ void CameraDeviceSession::cleanupBuffersLocked(int id) {
     }
     mCirculatingBuffers[id].clear();
     mCirculatingBuffers.erase(id);
+    mInflightBuffers.erase(id);
+}
+
+// Needs to get called after acquiring 'mInflightLock'
+size_t CameraDeviceSession::countInflightBuffersLocked() const {
+    size_t count = 0;
+    for (const auto& pair : mInflightBuffers) {
+        count += pair.second.size();
+    }
+    return count;
+}
+
+// Needs to get called after acquiring 'mInflightLock'
+bool CameraDeviceSession::isBufferInflightLocked(int streamId, uint32_t frameNumber) {
+    auto it = mInflightBuffers.find(streamId);
+    return it != mInflightBuffers.end() && it->second.find(frameNumber) != nullptr;
 }
 
 void CameraDeviceSession::updateBufferCaches(const hidl_vec<BufferCache>& cachesToRemove) {
@@ -1035,8 +1353,9 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
         return Status::ILLEGAL_ARGUMENT;
     }
 
-    hidl_vec<buffer_handle_t*> allBufPtrs;
-    hidl_vec<int> allFences;
+    // reused by every request so that the request path does not allocate
+    std::vector<buffer_handle_t*>& allBufPtrs = mRequestBufPtrs;
+    std::vector<int>& allFences = mRequestFences;
     bool hasInputBuf = (request.inputBuffer.streamId != -1 &&
             request.inputBuffer.bufferId != 0);
     size_t numOutputBufs = request.outputBuffers.size();
@@ -1052,15 +1371,15 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
         return status;
     }
 
-    hidl_vec<camera3_stream_buffer_t> outHalBufs;
+    std::vector<camera3_stream_buffer_t>& outHalBufs = mRequestHalBufs;
     outHalBufs.resize(numOutputBufs);
     bool aeCancelTriggerNeeded = false;
     ::android::hardware::camera::common::V1_0::helper::CameraMetadata settingsOverride;
     {
         Mutex::Autolock _l(mInflightLock);
         if (hasInputBuf) {
-            auto key = std::make_pair(request.inputBuffer.streamId, request.frameNumber);
-            auto& bufCache = mInflightBuffers[key] = camera3_stream_buffer_t{};
+            auto& bufCache = mInflightBuffers[request.inputBuffer.streamId].emplace(
+                    request.frameNumber) = camera3_stream_buffer_t{};
             convertFromHidl(
                     allBufPtrs[numOutputBufs], request.inputBuffer.status,
                     &mStreamMap[request.inputBuffer.streamId], allFences[numOutputBufs],
@@ -1072,8 +1391,8 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
 
         halRequest.num_output_buffers = numOutputBufs;
         for (size_t i = 0; i < numOutputBufs; i++) {
-            auto key = std::make_pair(request.outputBuffers[i].streamId, request.frameNumber);
-            auto& bufCache = mInflightBuffers[key] = camera3_stream_buffer_t{};
+            auto& bufCache = mInflightBuffers[request.outputBuffers[i].streamId].emplace(
+                    request.frameNumber) = camera3_stream_buffer_t{};
             convertFromHidl(
                     allBufPtrs[i], request.outputBuffers[i].status,
                     &mStreamMap[request.outputBuffers[i].streamId], allFences[i],
@@ -1086,7 +1405,7 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
         aeCancelTriggerNeeded = handleAePrecaptureCancelRequestLocked(
                 halRequest, &settingsOverride /*out*/, &triggerOverride/*out*/);
         if (aeCancelTriggerNeeded) {
-            mInflightAETriggerOverrides[halRequest.frame_number] =
+            mInflightAETriggerOverrides.emplace(halRequest.frame_number) =
                     triggerOverride;
             halRequest.settings = settingsOverride.getAndLock();
         }
@@ -1105,12 +1424,10 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
 
         cleanupInflightFences(allFences, numBufs);
         if (hasInputBuf) {
-            auto key = std::make_pair(request.inputBuffer.streamId, request.frameNumber);
-            mInflightBuffers.erase(key);
+            mInflightBuffers[request.inputBuffer.streamId].erase(request.frameNumber);
         }
         for (size_t i = 0; i < numOutputBufs; i++) {
-            auto key = std::make_pair(request.outputBuffers[i].streamId, request.frameNumber);
-            mInflightBuffers.erase(key);
+            mInflightBuffers[request.outputBuffers[i].streamId].erase(request.frameNumber);
         }
         if (aeCancelTriggerNeeded) {
             mInflightAETriggerOverrides.erase(request.frameNumber);
@@ -1130,6 +1447,8 @@ Return<Status> CameraDeviceSession::flush()  {
         if (ret != OK) {
             status = Status::INTERNAL_ERROR;
         }
+        // the HAL has returned everything, make sure camera service has received it as well
+        mResultBatcher.waitForDispatch();
     }
     return status;
 }
@@ -1139,9 +1458,10 @@ Return<void> CameraDeviceSession::close()  {
     if (!mClosed) {
         {
             Mutex::Autolock _l(mInflightLock);
-            if (!mInflightBuffers.empty()) {
+            size_t numInflightBuffers = countInflightBuffersLocked();
+            if (numInflightBuffers > 0) {
                 ALOGE("%s: trying to close while there are still %zu inflight buffers!",
-                        __FUNCTION__, mInflightBuffers.size());
+                        __FUNCTION__, numInflightBuffers);
             }
             if (!mInflightAETriggerOverrides.empty()) {
                 ALOGE("%s: trying to close while there are still %zu inflight "
@@ -1160,6 +1480,9 @@ Return<void> CameraDeviceSession::close()  {
         mDevice->common.close(&mDevice->common);
         ATRACE_END();
 
+        // no more results can come from the HAL, send the ones still queued
+        mResultBatcher.stopDispatch();
+
         // free all imported buffers
         for(auto& pair : mCirculatingBuffers) {
             CirculatingBuffers& buffers = pair.second;
@@ -1191,8 +1514,7 @@ void CameraDeviceSession::sProcessCaptureResult(
         if (hasInputBuf) {
             int streamId = static_cast<Camera3Stream*>(hal_result->input_buffer->stream)->mId;
             // validate if buffer is inflight
-            auto key = std::make_pair(streamId, frameNumber);
-            if (d->mInflightBuffers.count(key) != 1) {
+            if (!d->isBufferInflightLocked(streamId, frameNumber)) {
                 ALOGE("%s: input buffer for stream %d frame %d is not inflight!",
                         __FUNCTION__, streamId, frameNumber);
                 return;
@@ -1202,8 +1524,7 @@ void CameraDeviceSession::sProcessCaptureResult(
         for (size_t i = 0; i < numOutputBufs; i++) {
             int streamId = static_cast<Camera3Stream*>(hal_result->output_buffers[i].stream)->mId;
             // validate if buffer is inflight
-            auto key = std::make_pair(streamId, frameNumber);
-            if (d->mInflightBuffers.count(key) != 1) {
+            if (!d->isBufferInflightLocked(streamId, frameNumber)) {
                 ALOGE("%s: output buffer for stream %d frame %d is not inflight!",
                         __FUNCTION__, streamId, frameNumber);
                 return;
@@ -1217,8 +1538,8 @@ void CameraDeviceSession::sProcessCaptureResult(
     result.fmqResultSize = 0;
     result.partialResult = hal_result->partial_result;
     convertToHidl(hal_result->result, &result.result);
+    ResultOverride resultOverride;
     if (nullptr != hal_result->result) {
-        bool resultOverriden = false;
         Mutex::Autolock _l(d->mInflightLock);
 
         // Derive some new keys for backward compatibility
@@ -1226,25 +1547,16 @@ void CameraDeviceSession::sProcessCaptureResult(
             camera_metadata_ro_entry entry;
             if (find_camera_metadata_ro_entry(hal_result->result,
                     ANDROID_CONTROL_POST_RAW_SENSITIVITY_BOOST, &entry) == 0) {
-                d->mInflightRawBoostPresent[frameNumber] = true;
+                d->mInflightRawBoostPresent.emplace(frameNumber) = true;
             } else {
-                auto entry = d->mInflightRawBoostPresent.find(frameNumber);
-                if (d->mInflightRawBoostPresent.end() == entry) {
-                    d->mInflightRawBoostPresent[frameNumber] = false;
-                }
+                // adds a false entry unless the key was in an earlier partial result
+                d->mInflightRawBoostPresent.emplace(frameNumber);
             }
 
             if ((hal_result->partial_result == d->mNumPartialResults)) {
-                if (!d->mInflightRawBoostPresent[frameNumber]) {
-                    if (!resultOverriden) {
-                        d->mOverridenResult.clear();
-                        d->mOverridenResult.append(hal_result->result);
-                        resultOverriden = true;
-                    }
-                    int32_t defaultBoost[1] = {100};
-                    d->mOverridenResult.update(
-                            ANDROID_CONTROL_POST_RAW_SENSITIVITY_BOOST,
-                            defaultBoost, 1);
+                if (!d->mInflightRawBoostPresent.emplace(frameNumber)) {
+                    int32_t defaultBoost = 100;
+                    resultOverride.add(ANDROID_CONTROL_POST_RAW_SENSITIVITY_BOOST, defaultBoost);
                 }
 
                 d->mInflightRawBoostPresent.erase(frameNumber);
@@ -1252,25 +1564,12 @@ void CameraDeviceSession::sProcessCaptureResult(
         }
 
         auto entry = d->mInflightAETriggerOverrides.find(frameNumber);
-        if (d->mInflightAETriggerOverrides.end() != entry) {
-            if (!resultOverriden) {
-                d->mOverridenResult.clear();
-                d->mOverridenResult.append(hal_result->result);
-                resultOverriden = true;
-            }
-            d->overrideResultForPrecaptureCancelLocked(entry->second,
-                    &d->mOverridenResult);
+        if (entry != nullptr) {
+            d->overrideResultForPrecaptureCancelLocked(*entry, &resultOverride);
             if (hal_result->partial_result == d->mNumPartialResults) {
                 d->mInflightAETriggerOverrides.erase(frameNumber);
             }
         }
-
-        if (resultOverriden) {
-            const camera_metadata_t *metaBuffer =
-                    d->mOverridenResult.getAndLock();
-            convertToHidl(metaBuffer, &result.result);
-            d->mOverridenResult.unlock(metaBuffer);
-        }
     }
     if (hasInputBuf) {
         result.inputBuffer.streamId =
@@ -1313,22 +1612,16 @@ void CameraDeviceSession::sProcessCaptureResult(
         Mutex::Autolock _l(d->mInflightLock);
         if (hasInputBuf) {
             int streamId = static_cast<Camera3Stream*>(hal_result->input_buffer->stream)->mId;
-            auto key = std::make_pair(streamId, frameNumber);
-            d->mInflightBuffers.erase(key);
+            d->mInflightBuffers[streamId].erase(frameNumber);
         }
 
         for (size_t i = 0; i < numOutputBufs; i++) {
             int streamId = static_cast<Camera3Stream*>(hal_result->output_buffers[i].stream)->mId;
-            auto key = std::make_pair(streamId, frameNumber);
-            d->mInflightBuffers.erase(key);
-        }
-
-        if (d->mInflightBuffers.empty()) {
-            ALOGV("%s: inflight buffer queue is now empty!", __FUNCTION__);
+            d->mInflightBuffers[streamId].erase(frameNumber);
         }
     }
 
-    d->mResultBatcher.processCaptureResult(result);
+    d->mResultBatcher.processCaptureResult(result, resultOverride);
 }
 
 void CameraDeviceSession::sNotify(
@@ -1354,19 +1647,8 @@ void CameraDeviceSession::sNotify(
             case ErrorCode::ERROR_REQUEST:
             case ErrorCode::ERROR_RESULT: {
                 Mutex::Autolock _l(d->mInflightLock);
-                auto entry = d->mInflightAETriggerOverrides.find(
-                        hidlMsg.msg.error.frameNumber);
-                if (d->mInflightAETriggerOverrides.end() != entry) {
-                    d->mInflightAETriggerOverrides.erase(
-                            hidlMsg.msg.error.frameNumber);
-                }
-
-                auto boostEntry = d->mInflightRawBoostPresent.find(
-                        hidlMsg.msg.error.frameNumber);
-                if (d->mInflightRawBoostPresent.end() != boostEntry) {
-                    d->mInflightRawBoostPresent.erase(
-                            hidlMsg.msg.error.frameNumber);
-                }
+                d->mInflightAETriggerOverrides.erase(hidlMsg.msg.error.frameNumber);
+                d->mInflightRawBoostPresent.erase(hidlMsg.msg.error.frameNumber);
 
             }
                 break;
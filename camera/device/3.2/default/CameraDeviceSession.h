@@ -25,12 +25,17 @@
 #include <include/convert.h>
 #include <deque>
 #include <map>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 #include "CameraMetadata.h"
 #include "HandleImporter.h"
+#include "InflightFrameMap.h"
 #include "hardware/camera3.h"
 #include "hardware/camera_common.h"
+#include "utils/Condition.h"
 #include "utils/Mutex.h"
+#include "utils/Timers.h"
 
 namespace android {
 namespace hardware {
@@ -132,6 +137,33 @@ protected:
         uint8_t aePrecaptureTrigger;
     };
 
+    // Result metadata entries to replace or add before a result is sent to camera service. They
+    // are applied while the metadata is copied into the result FMQ, so that the HAL's metadata
+    // does not have to be cloned and resized just to change a few entries.
+    struct ResultOverride {
+        static constexpr size_t kMaxEntries = 3;
+        struct Entry {
+            uint32_t tag;
+            // the tag must be of TYPE_BYTE or TYPE_INT32
+            int32_t value;
+        };
+        size_t numEntries = 0;
+        Entry entries[kMaxEntries];
+
+        bool empty() const { return numEntries == 0; }
+        void add(uint32_t tag, int32_t value);
+    };
+
+    // Returns the size of src with resultOverride applied, and the capacities it needs
+    static size_t getOverriddenMetadataCapacity(
+            const camera_metadata_t* src, const ResultOverride& resultOverride,
+            size_t* entryCapacity, size_t* dataCapacity);
+    // Copy src into dst with resultOverride applied. dstSize must be the size returned by
+    // getOverriddenMetadataCapacity.
+    static bool writeOverriddenMetadata(
+            const camera_metadata_t* src, const ResultOverride& resultOverride,
+            uint8_t* dst, size_t dstSize);
+
     camera3_device_t* mDevice;
     uint32_t mDeviceVersion;
     bool mIsAELockAvailable;
@@ -141,13 +173,12 @@ protected:
     std::map<int, Camera3Stream> mStreamMap;
 
     mutable Mutex mInflightLock; // protecting mInflightBuffers and mCirculatingBuffers
-    // (streamID, frameNumber) -> inflight buffer cache
-    std::map<std::pair<int, uint32_t>, camera3_stream_buffer_t>  mInflightBuffers;
+    // streamID -> (frameNumber -> inflight buffer cache)
+    std::map<int, InflightFrameMap<camera3_stream_buffer_t>> mInflightBuffers;
 
     // (frameNumber, AETriggerOverride) -> inflight request AETriggerOverrides
-    std::map<uint32_t, AETriggerCancelOverride> mInflightAETriggerOverrides;
-    ::android::hardware::camera::common::V1_0::helper::CameraMetadata mOverridenResult;
-    std::map<uint32_t, bool> mInflightRawBoostPresent;
+    InflightFrameMap<AETriggerCancelOverride> mInflightAETriggerOverrides;
+    InflightFrameMap<bool> mInflightRawBoostPresent;
     ::android::hardware::camera::common::V1_0::helper::CameraMetadata mOverridenRequest;
 
     // buffers currently ciculating between HAL and camera service
@@ -164,6 +195,12 @@ protected:
     bool mInitFail;
     bool mFirstRequest = false;
 
+    // Scratch space of processOneCaptureRequest. Capture requests are not processed
+    // concurrently, as they share mCirculatingBuffers without locking as well.
+    std::vector<buffer_handle_t*> mRequestBufPtrs;
+    std::vector<int> mRequestFences;
+    std::vector<camera3_stream_buffer_t> mRequestHalBufs;
+
     common::V1_0::helper::CameraMetadata mDeviceInfo;
 
     using RequestMetadataQueue = MessageQueue<uint8_t, kSynchronizedReadWrite>;
@@ -174,13 +211,21 @@ protected:
     class ResultBatcher {
     public:
         ResultBatcher(const sp<ICameraDeviceCallback>& callback);
+        ~ResultBatcher();
         void setNumPartialResults(uint32_t n);
         void setBatchedStreams(const std::vector<int>& streamsToBatch);
         void setResultMetadataQueue(std::shared_ptr<ResultMetadataQueue> q);
 
         void registerBatch(const hidl_vec<CaptureRequest>& requests);
         void notify(NotifyMsg& msg);
-        void processCaptureResult(CaptureResult& result);
+        void processCaptureResult(CaptureResult& result, const ResultOverride& resultOverride);
+
+        // Block until every queued result and notification has been sent to camera service
+        void waitForDispatch();
+        // Send whatever is still queued and stop the dispatch thread. Must only be called once
+        // the HAL can no longer call processCaptureResult or notify.
+        void stopDispatch();
+        void dump(int fd);
 
     private:
         struct InflightBatch {
@@ -256,8 +301,20 @@ protected:
         // helper methods
         void freeReleaseFences(hidl_vec<CaptureResult>&);
         void notifySingleMsg(NotifyMsg& msg);
-        void processOneCaptureResult(CaptureResult& result);
-        void invokeProcessCaptureResultCallback(hidl_vec<CaptureResult> &results, bool tryWriteFmq);
+        void processOneCaptureResult(CaptureResult& result, const ResultOverride& resultOverride);
+
+        // Results and notifications are not sent from the HAL callback thread, but queued for
+        // mDispatchThread so that a slow camera service never stalls the HAL. The queue methods
+        // take over the results, including their release fences.
+        void queueCaptureResults(hidl_vec<CaptureResult>& results, bool tryWriteFmq);
+        void queueNotifyMsgs(const std::vector<NotifyMsg>& msgs);
+        void queueCaptureResultLocked(CaptureResult& result, bool tryWriteFmq,
+                const ResultOverride& resultOverride, nsecs_t queuedTime);
+        // Returns the number of bytes written into the FMQ, or 0 if the metadata did not fit
+        size_t writeResultMetadataLocked(
+                const hidl_vec<uint8_t>& metadata, const ResultOverride& resultOverride);
+        static hidl_vec<uint8_t> copyResultMetadata(
+                const hidl_vec<uint8_t>& metadata, const ResultOverride& resultOverride);
 
         // move/push function avoids "hidl_handle& operator=(hidl_handle&)", which clones native
         // handle
@@ -274,8 +331,46 @@ protected:
         const sp<ICameraDeviceCallback> mCallback;
         std::shared_ptr<ResultMetadataQueue> mResultMetadataQueue;
 
-        // Protect against invokeProcessCaptureResultCallback()
-        Mutex mProcessCaptureResultLock;
+        struct PendingCallback {
+            bool mIsResult;
+            NotifyMsg mMsg;
+            CaptureResult mResult;
+            nsecs_t mQueuedTime;
+        };
+
+        struct DispatchStats {
+            uint64_t mNumCallbacks = 0;
+            uint64_t mNumIpcs = 0;
+            nsecs_t mTotalQueueDelay = 0;
+            nsecs_t mMaxQueueDelay = 0;
+        };
+
+        void dispatchLoop();
+        // Consecutive results or notifications are coalesced into a single HIDL call, which
+        // happens whenever camera service falls behind
+        void dispatchPending(std::deque<PendingCallback>& pending, DispatchStats* stats);
+
+        // Protect mPending, mDispatching, mDispatchStopped, mDispatchStats, mMetadataStats and
+        // mOverrideBuffer. Result metadata is also written into the FMQ under this lock, so that
+        // the FMQ and mPending are always in the same order.
+        Mutex mDispatchLock;
+        Condition mPendingCond;
+        Condition mDrainedCond;
+        // There is no need to bound this queue: the HAL cannot produce more results than there
+        // are inflight requests
+        std::deque<PendingCallback> mPending;
+        bool mDispatching = false;
+        bool mDispatchStopped = false;
+        DispatchStats mDispatchStats;
+        std::thread mDispatchThread;
+
+        // Result metadata copied by queueCaptureResultLocked, into the FMQ or otherwise
+        struct MetadataStats {
+            uint64_t mNumResults = 0;
+            uint64_t mBytesCopied = 0;
+        } mMetadataStats;
+        // Scratch space for overridden metadata that cannot be built in the FMQ directly
+        std::vector<uint8_t> mOverrideBuffer;
 
     } mResultBatcher;
 
@@ -288,14 +383,18 @@ protected:
     // Validate and import request's input buffer and acquire fence
     Status importRequest(
             const CaptureRequest& request,
-            hidl_vec<buffer_handle_t*>& allBufPtrs,
-            hidl_vec<int>& allFences);
+            std::vector<buffer_handle_t*>& allBufPtrs,
+            std::vector<int>& allFences);
 
     static void cleanupInflightFences(
-            hidl_vec<int>& allFences, size_t numFences);
+            std::vector<int>& allFences, size_t numFences);
 
     void cleanupBuffersLocked(int id);
 
+    // Total number of inflight buffers of all streams
+    size_t countInflightBuffersLocked() const;
+    bool isBufferInflightLocked(int streamId, uint32_t frameNumber);
+
     void updateBufferCaches(const hidl_vec<BufferCache>& cachesToRemove);
 
     android_dataspace mapToLegacyDataspace(
@@ -308,7 +407,7 @@ protected:
 
     void overrideResultForPrecaptureCancelLocked(
             const AETriggerCancelOverride &aeTriggerCancelOverride,
-            ::android::hardware::camera::common::V1_0::helper::CameraMetadata *settings /*out*/);
+            ResultOverride *resultOverride /*out*/);
 
     Status processOneCaptureRequest(const CaptureRequest& request);
     /**
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_CAMERA_DEVICE_V3_2_INFLIGHTFRAMEMAP_H
+#define ANDROID_HARDWARE_CAMERA_DEVICE_V3_2_INFLIGHTFRAMEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <map>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace V3_2 {
+namespace implementation {
+
+/**
+ * Bookkeeping of inflight frames, keyed by frame number. Frame numbers increase monotonically
+ * and only a pipeline's worth of them is inflight at once, so entries are kept in a ring indexed
+ * by frame number modulo kRingSize and no memory is allocated per frame. A frame whose ring slot
+ * is still taken by an older frame goes to an overflow map instead.
+ */
+template <typename T>
+class InflightFrameMap {
+public:
+    InflightFrameMap() : mSize(0) {
+        for (auto& slot : mSlots) {
+            slot.used = false;
+        }
+    }
+
+    // Returns nullptr if the frame is not inflight
+    T* find(uint32_t frameNumber) {
+        Slot& slot = mSlots[frameNumber % kRingSize];
+        if (slot.used && slot.frameNumber == frameNumber) {
+            return &slot.value;
+        }
+        if (mOverflow.empty()) {
+            return nullptr;
+        }
+        auto it = mOverflow.find(frameNumber);
+        return (it != mOverflow.end()) ? &it->second : nullptr;
+    }
+
+    // Returns the entry of the frame, value-initialized if the frame was not inflight.
+    // The reference stays valid until the frame is erased.
+    T& emplace(uint32_t frameNumber) {
+        T* value = find(frameNumber);
+        if (value != nullptr) {
+            return *value;
+        }
+
+        mSize++;
+        Slot& slot = mSlots[frameNumber % kRingSize];
+        if (!slot.used) {
+            slot.used = true;
+            slot.frameNumber = frameNumber;
+            slot.value = T();
+            return slot.value;
+        }
+        return mOverflow[frameNumber];
+    }
+
+    bool erase(uint32_t frameNumber) {
+        Slot& slot = mSlots[frameNumber % kRingSize];
+        if (slot.used && slot.frameNumber == frameNumber) {
+            slot.used = false;
+            mSize--;
+            return true;
+        }
+        if (mOverflow.erase(frameNumber) > 0) {
+            mSize--;
+            return true;
+        }
+        return false;
+    }
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+private:
+    static constexpr size_t kRingSize = 32;
+
+    struct Slot {
+        bool used;
+        uint32_t frameNumber;
+        T value;
+    };
+
+    std::array<Slot, kRingSize> mSlots;
+    std::map<uint32_t, T> mOverflow;
+    size_t mSize;
+};
+
+}  // namespace implementation
+}  // namespace V3_2
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_CAMERA_DEVICE_V3_2_INFLIGHTFRAMEMAP_H
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "InflightFrameMap.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace V3_2 {
+namespace implementation {
+
+namespace {
+
+TEST(InflightFrameMapTest, emplaceFindErase) {
+    InflightFrameMap<int> frames;
+    ASSERT_TRUE(frames.empty());
+    ASSERT_EQ(nullptr, frames.find(7));
+
+    frames.emplace(7) = 70;
+    ASSERT_EQ(1u, frames.size());
+    ASSERT_NE(nullptr, frames.find(7));
+    ASSERT_EQ(70, *frames.find(7));
+
+    // Emplacing an inflight frame returns the existing entry
+    ASSERT_EQ(70, frames.emplace(7));
+    ASSERT_EQ(1u, frames.size());
+
+    ASSERT_TRUE(frames.erase(7));
+    ASSERT_FALSE(frames.erase(7));
+    ASSERT_EQ(nullptr, frames.find(7));
+    ASSERT_TRUE(frames.empty());
+
+    // A reused slot starts from a value-initialized entry
+    ASSERT_EQ(0, frames.emplace(7));
+}
+
+TEST(InflightFrameMapTest, framesSharingASlot) {
+    InflightFrameMap<int> frames;
+    // Frame numbers a multiple of any plausible ring size apart share a ring slot
+    const uint32_t kStride = 1 << 16;
+    for (uint32_t i = 0; i < 10; i++) {
+        frames.emplace(i * kStride) = i;
+    }
+    ASSERT_EQ(10u, frames.size());
+    for (uint32_t i = 0; i < 10; i++) {
+        ASSERT_NE(nullptr, frames.find(i * kStride));
+        ASSERT_EQ(static_cast<int>(i), *frames.find(i * kStride));
+    }
+
+    // Frames still in the overflow map stay reachable once the slot frees up
+    ASSERT_TRUE(frames.erase(0));
+    ASSERT_EQ(nullptr, frames.find(0));
+    ASSERT_EQ(9, frames.emplace(9 * kStride));
+    frames.emplace(10 * kStride) = 10;
+    for (uint32_t i = 1; i <= 10; i++) {
+        ASSERT_TRUE(frames.erase(i * kStride));
+    }
+    ASSERT_TRUE(frames.empty());
+}
+
+TEST(InflightFrameMapTest, matchesStdMap) {
+    InflightFrameMap<uint32_t> frames;
+    std::map<uint32_t, uint32_t> expected;
+    std::mt19937 rng(20161116);
+
+    // Requests come in order and complete mostly, but not always, in order, with the occasional
+    // frame number far off the pipeline to exercise the overflow path.
+    uint32_t nextFrame = 0;
+    for (int i = 0; i < 200000; i++) {
+        uint32_t op = rng() % 8;
+        if (op < 3) {
+            uint32_t frame = (rng() % 64 == 0) ? nextFrame + (rng() % 256) : nextFrame++;
+            uint32_t& value = frames.emplace(frame);
+            auto inserted = expected.emplace(frame, rng());
+            if (inserted.second) {
+                value = inserted.first->second;
+            } else {
+                ASSERT_EQ(inserted.first->second, value) << "frame " << frame;
+            }
+        } else if (op < 6) {
+            uint32_t frame = expected.empty() || rng() % 4 == 0
+                    ? nextFrame - (rng() % 64)
+                    : expected.begin()->first + (rng() % 4);
+            ASSERT_EQ(expected.erase(frame) > 0, frames.erase(frame)) << "frame " << frame;
+        } else {
+            uint32_t frame = nextFrame - (rng() % 96);
+            auto it = expected.find(frame);
+            uint32_t* value = frames.find(frame);
+            if (it == expected.end()) {
+                ASSERT_EQ(nullptr, value) << "frame " << frame;
+            } else {
+                ASSERT_NE(nullptr, value) << "frame " << frame;
+                ASSERT_EQ(it->second, *value) << "frame " << frame;
+            }
+        }
+        ASSERT_EQ(expected.size(), frames.size());
+    }
+
+    for (const auto& entry : expected) {
+        ASSERT_NE(nullptr, frames.find(entry.first));
+        ASSERT_EQ(entry.second, *frames.find(entry.first));
+    }
+}
+
+template <typename Map>
+int64_t timePipelineNanos(Map& frames, int numFrames, int depth) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numFrames; i++) {
+        frames.emplace(i);
+        if (i >= depth) {
+            frames.erase(i - depth);
+        }
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(InflightFrameMapTest, pipelineBenchmark) {
+    const int kFrames = 1000000;
+    const int kDepth = 8;
+
+    struct StdMap {
+        std::map<uint32_t, bool> map;
+        void emplace(uint32_t frame) { map[frame]; }
+        void erase(uint32_t frame) { map.erase(frame); }
+    } stdMap;
+    InflightFrameMap<bool> frames;
+
+    int64_t ringNanos = timePipelineNanos(frames, kFrames, kDepth);
+    int64_t mapNanos = timePipelineNanos(stdMap, kFrames, kDepth);
+    ASSERT_EQ(static_cast<size_t>(kDepth), frames.size());
+    ASSERT_EQ(static_cast<size_t>(kDepth), stdMap.map.size());
+
+    std::cout << "Inflight frame emplace + erase, " << kDepth << " frames deep: ring "
+              << ringNanos / kFrames << "ns, std::map " << mapNanos / kFrames << "ns" << std::endl;
+}
+
+}  // namespace anonymous
+
+}  // namespace implementation
+}  // namespace V3_2
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
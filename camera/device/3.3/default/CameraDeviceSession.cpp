@@ -49,9 +49,10 @@ Return<void> CameraDeviceSession::configureStreams_3_3(
     // hold the inflight lock for entire configureStreams scope since there must not be any
     // inflight request/results during stream configuration.
     Mutex::Autolock _l(mInflightLock);
-    if (!mInflightBuffers.empty()) {
+    size_t numInflightBuffers = countInflightBuffersLocked();
+    if (numInflightBuffers > 0) {
         ALOGE("%s: trying to configureStreams while there are still %zu inflight buffers!",
-                __FUNCTION__, mInflightBuffers.size());
+                __FUNCTION__, numInflightBuffers);
         _hidl_cb(Status::INTERNAL_ERROR, outStreams);
         return Void();
     }
@@ -19,6 +19,8 @@
 #include "Gralloc1Allocator.h"
 #include "GrallocBufferDescriptor.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include <string.h>
@@ -36,8 +38,22 @@ using android::hardware::graphics::common::V1_0::BufferUsage;
 using android::hardware::graphics::mapper::V2_0::implementation::
     grallocDecodeBufferDescriptor;
 
+namespace {
+
+// Large buffers take milliseconds to allocate, so a batch is allocated by up
+// to this many threads at once, including the calling thread.
+constexpr uint32_t kMaxAllocationThreads = 4;
+
+}  // anonymous namespace
+
 Gralloc1Allocator::Gralloc1Allocator(const hw_module_t* module)
-    : mDevice(nullptr), mCapabilities(), mDispatch() {
+    : mDevice(nullptr),
+      mWorkerTask(nullptr),
+      mWorkerGeneration(0),
+      mBusyWorkers(0),
+      mStopWorkers(false),
+      mCapabilities(),
+      mDispatch() {
     int result = gralloc1_open(module, &mDevice);
     if (result) {
         LOG_ALWAYS_FATAL("failed to open gralloc1 device: %s",
@@ -49,6 +65,15 @@ Gralloc1Allocator::Gralloc1Allocator(const hw_module_t* module)
 }
 
 Gralloc1Allocator::~Gralloc1Allocator() {
+    {
+        std::lock_guard<std::mutex> lock(mWorkerMutex);
+        mStopWorkers = true;
+    }
+    mWorkerCondition.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+
     gralloc1_close(mDevice);
 }
 
@@ -132,43 +157,20 @@ Return<void> Gralloc1Allocator::allocate(const BufferDescriptor& descriptor,
     }
 
     uint32_t stride = 0;
-    std::vector<hidl_handle> buffers;
-    buffers.reserve(count);
-
-    // allocate the buffers
-    for (uint32_t i = 0; i < count; i++) {
-        buffer_handle_t tmpBuffer;
-        uint32_t tmpStride;
-        error = allocateOne(desc, &tmpBuffer, &tmpStride);
-        if (error != Error::NONE) {
-            break;
-        }
-
-        if (stride == 0) {
-            stride = tmpStride;
-        } else if (stride != tmpStride) {
-            // non-uniform strides
-            mDispatch.release(mDevice, tmpBuffer);
-            stride = 0;
-            error = Error::UNSUPPORTED;
-            break;
-        }
-
-        buffers.emplace_back(hidl_handle(tmpBuffer));
-    }
+    std::vector<buffer_handle_t> buffers;
+    error = allocateBuffers(desc, count, &buffers, &stride);
 
     mDispatch.destroyDescriptor(mDevice, desc);
 
     // return the buffers
+    std::vector<hidl_handle> handles(buffers.begin(), buffers.end());
     hidl_vec<hidl_handle> hidl_buffers;
-    if (error == Error::NONE) {
-        hidl_buffers.setToExternal(buffers.data(), buffers.size());
-    }
+    hidl_buffers.setToExternal(handles.data(), handles.size());
     hidl_cb(error, stride, hidl_buffers);
 
     // free the buffers
-    for (const auto& buffer : buffers) {
-        mDispatch.release(mDevice, buffer.getNativeHandle());
+    for (auto buffer : buffers) {
+        mDispatch.release(mDevice, buffer);
     }
 
     return Void();
@@ -321,6 +323,113 @@ Error Gralloc1Allocator::allocateOne(gralloc1_buffer_descriptor_t descriptor,
     return Error::NONE;
 }
 
+Error Gralloc1Allocator::allocateBuffers(
+    gralloc1_buffer_descriptor_t descriptor, uint32_t count,
+    std::vector<buffer_handle_t>* outBuffers, uint32_t* outStride) {
+    std::vector<buffer_handle_t> buffers(count, nullptr);
+    std::vector<uint32_t> strides(count, 0);
+    std::vector<Error> errors(count, Error::NONE);
+
+    // each thread allocates the next buffer until all buffers are allocated
+    // or an allocation fails
+    std::atomic<uint32_t> next(0);
+    std::atomic<bool> failed(false);
+    auto allocateNext = [&]() {
+        uint32_t i;
+        while (!failed && (i = next++) < count) {
+            errors[i] = allocateOne(descriptor, &buffers[i], &strides[i]);
+            if (errors[i] != Error::NONE) {
+                buffers[i] = nullptr;
+                failed = true;
+            }
+        }
+    };
+
+    std::unique_lock<std::mutex> batchLock(mBatchMutex, std::defer_lock);
+    if (count > 1 && batchLock.try_lock()) {
+        runOnWorkers(allocateNext);
+    } else {
+        allocateNext();
+    }
+
+    Error error = Error::NONE;
+    for (uint32_t i = 0; i < count; i++) {
+        if (errors[i] != Error::NONE) {
+            error = errors[i];
+            break;
+        }
+        if (buffers[i] == nullptr) {
+            // not allocated because another allocation failed first
+            error = Error::NO_RESOURCES;
+        } else if (strides[i] != strides[0]) {
+            // non-uniform strides
+            error = Error::UNSUPPORTED;
+        }
+    }
+
+    if (error != Error::NONE) {
+        for (auto buffer : buffers) {
+            if (buffer) {
+                mDispatch.release(mDevice, buffer);
+            }
+        }
+        outBuffers->clear();
+        *outStride = 0;
+        return error;
+    }
+
+    *outBuffers = std::move(buffers);
+    *outStride = (count > 0) ? strides[0] : 0;
+
+    return Error::NONE;
+}
+
+void Gralloc1Allocator::runOnWorkers(const std::function<void()>& task) {
+    std::unique_lock<std::mutex> lock(mWorkerMutex);
+    if (mWorkers.empty()) {
+        mWorkers.reserve(kMaxAllocationThreads - 1);
+        for (uint32_t i = 1; i < kMaxAllocationThreads; i++) {
+            mWorkers.emplace_back(&Gralloc1Allocator::workerLoop, this);
+        }
+    }
+
+    mWorkerTask = &task;
+    mWorkerGeneration++;
+    mBusyWorkers = mWorkers.size();
+    lock.unlock();
+    mWorkerCondition.notify_all();
+
+    task();
+
+    lock.lock();
+    mWorkerDoneCondition.wait(lock, [this] { return mBusyWorkers == 0; });
+    mWorkerTask = nullptr;
+}
+
+void Gralloc1Allocator::workerLoop() {
+    std::unique_lock<std::mutex> lock(mWorkerMutex);
+    // workers are started for the batch being posted, so they run it first
+    uint64_t generation = mWorkerGeneration - 1;
+    while (true) {
+        mWorkerCondition.wait(lock, [this, generation] {
+            return mStopWorkers || mWorkerGeneration != generation;
+        });
+        if (mStopWorkers) {
+            break;
+        }
+
+        generation = mWorkerGeneration;
+        const std::function<void()>* task = mWorkerTask;
+        lock.unlock();
+        (*task)();
+        lock.lock();
+
+        if (--mBusyWorkers == 0) {
+            mWorkerDoneCondition.notify_one();
+        }
+    }
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace allocator
@@ -17,6 +17,12 @@
 #ifndef ANDROID_HARDWARE_GRAPHICS_ALLOCATOR_V2_0_GRALLOC1ALLOCATOR_H
 #define ANDROID_HARDWARE_GRAPHICS_ALLOCATOR_V2_0_GRALLOC1ALLOCATOR_H
 
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <android/hardware/graphics/allocator/2.0/IAllocator.h>
 #include <android/hardware/graphics/mapper/2.0/IMapper.h>
 #include <hardware/gralloc1.h>
@@ -57,9 +63,35 @@ class Gralloc1Allocator : public IAllocator {
                            gralloc1_buffer_descriptor_t* outDescriptor);
     Error allocateOne(gralloc1_buffer_descriptor_t descriptor,
                       buffer_handle_t* outBuffer, uint32_t* outStride);
+    // Allocates the buffers on the calling thread, helped by the allocation
+    // workers unless another batch is using them.
+    Error allocateBuffers(gralloc1_buffer_descriptor_t descriptor,
+                          uint32_t count,
+                          std::vector<buffer_handle_t>* outBuffers,
+                          uint32_t* outStride);
+
+    // Runs task on the calling thread and all allocation workers, and
+    // returns once every one of them has returned from it.  Must be called
+    // with mBatchMutex held.
+    void runOnWorkers(const std::function<void()>& task);
+    void workerLoop();
 
     gralloc1_device_t* mDevice;
 
+    // Allocation workers, started on the first batch of more than one
+    // buffer and kept for the lifetime of the allocator.  One batch uses
+    // them at a time; concurrent batches are allocated serially.
+    std::mutex mBatchMutex;
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mWorkerMutex;
+    std::condition_variable mWorkerCondition;
+    std::condition_variable mWorkerDoneCondition;
+    const std::function<void()>* mWorkerTask;
+    uint64_t mWorkerGeneration;
+    uint32_t mBusyWorkers;
+    bool mStopWorkers;
+
     struct {
         bool layeredBuffers;
     } mCapabilities;
@@ -164,11 +164,11 @@ ComposerClient::~ComposerClient()
     for (const auto& dpy : mDisplayData) {
         ALOGW("destroying client resources for display %" PRIu64, dpy.first);
 
-        for (const auto& ly : dpy.second.Layers) {
+        for (const auto& ly : dpy.second->Layers) {
             mHal.destroyLayer(dpy.first, ly.first);
         }
 
-        if (dpy.second.IsVirtual) {
+        if (dpy.second->IsVirtual) {
             mHal.destroyVirtualDisplay(dpy.first);
         } else {
             ALOGW("performing a final presentDisplay");
@@ -222,7 +222,8 @@ void ComposerClient::onHotplug(Display display,
         std::lock_guard<std::mutex> lock(mDisplayDataMutex);
 
         if (connected == IComposerCallback::Connection::CONNECTED) {
-            mDisplayData.emplace(display, DisplayData(false));
+            mDisplayData.emplace(display,
+                    std::make_shared<DisplayData>(false));
         } else if (connected == IComposerCallback::Connection::DISCONNECTED) {
             mDisplayData.erase(display);
         }
@@ -233,6 +234,15 @@ void ComposerClient::onHotplug(Display display,
             ret.description().c_str());
 }
 
+std::shared_ptr<ComposerClient::DisplayData> ComposerClient::findDisplayData(
+        Display display)
+{
+    std::lock_guard<std::mutex> lock(mDisplayDataMutex);
+
+    auto dpy = mDisplayData.find(display);
+    return (dpy != mDisplayData.end()) ? dpy->second : nullptr;
+}
+
 void ComposerClient::onRefresh(Display display)
 {
     auto ret = mCallback->onRefresh(display);
@@ -270,10 +280,11 @@ Return<void> ComposerClient::createVirtualDisplay(uint32_t width,
     Error err = mHal.createVirtualDisplay(width, height,
             &formatHint, &display);
     if (err == Error::NONE) {
-        std::lock_guard<std::mutex> lock(mDisplayDataMutex);
+        auto dpy = std::make_shared<DisplayData>(true);
+        dpy->OutputBuffers.resize(outputBufferSlotCount);
 
-        auto dpy = mDisplayData.emplace(display, DisplayData(true)).first;
-        dpy->second.OutputBuffers.resize(outputBufferSlotCount);
+        std::lock_guard<std::mutex> lock(mDisplayDataMutex);
+        mDisplayData.emplace(display, std::move(dpy));
     }
 
     hidl_cb(err, display, formatHint);
@@ -298,11 +309,11 @@ Return<void> ComposerClient::createLayer(Display display,
     Layer layer = 0;
     Error err = mHal.createLayer(display, &layer);
     if (err == Error::NONE) {
-        std::lock_guard<std::mutex> lock(mDisplayDataMutex);
+        auto dpy = findDisplayData(display);
+        if (dpy) {
+            std::lock_guard<std::mutex> lock(dpy->Mutex);
 
-        auto dpy = mDisplayData.find(display);
-        if (dpy != mDisplayData.end()) {
-            auto ly = dpy->second.Layers.emplace(layer, LayerBuffers()).first;
+            auto ly = dpy->Layers.emplace(layer, LayerBuffers()).first;
             ly->second.Buffers.resize(bufferSlotCount);
         } else {
             layer = 0;
@@ -318,13 +329,15 @@ Return<Error> ComposerClient::destroyLayer(Display display, Layer layer)
 {
     Error err = mHal.destroyLayer(display, layer);
     if (err == Error::NONE) {
-        std::lock_guard<std::mutex> lock(mDisplayDataMutex);
-
-        auto dpy = mDisplayData.find(display);
-        if (dpy == mDisplayData.end()) {
+        auto dpy = findDisplayData(display);
+        if (!dpy) {
            return Error::BAD_DISPLAY;
         }
-        dpy->second.Layers.erase(layer);
+
+        std::lock_guard<std::mutex> lock(dpy->Mutex);
+        if (dpy->Layers.erase(layer)) {
+            dpy->LayersGeneration++;
+        }
     }
 
     return err;
@@ -427,14 +440,13 @@ Return<void> ComposerClient::getHdrCapabilities(Display display,
 Return<Error> ComposerClient::setClientTargetSlotCount(Display display,
         uint32_t clientTargetSlotCount)
 {
-    std::lock_guard<std::mutex> lock(mDisplayDataMutex);
-
-    auto dpy = mDisplayData.find(display);
-    if (dpy == mDisplayData.end()) {
+    auto dpy = findDisplayData(display);
+    if (!dpy) {
         return Error::BAD_DISPLAY;
     }
 
-    dpy->second.ClientTargets.resize(clientTargetSlotCount);
+    std::lock_guard<std::mutex> lock(dpy->Mutex);
+    dpy->ClientTargets.resize(clientTargetSlotCount);
 
     return Error::NONE;
 }
@@ -524,7 +536,8 @@ ComposerClient::createCommandReader()
 }
 
 ComposerClient::CommandReader::CommandReader(ComposerClient& client)
-    : mClient(client), mHal(client.mHal), mWriter(client.mWriter)
+    : mClient(client), mHal(client.mHal), mWriter(client.mWriter),
+      mLayerBuffers(nullptr), mLayerBuffersGeneration(0)
 {
 }
 
@@ -552,6 +565,10 @@ Error ComposerClient::CommandReader::parse()
         }
     }
 
+    // displays may be connected or disconnected before the next batch
+    mDisplayData = nullptr;
+    mLayerBuffers = nullptr;
+
     return (isEmpty()) ? Error::NONE : Error::BAD_PARAMETER;
 }
 
@@ -618,6 +635,9 @@ bool ComposerClient::CommandReader::parseSelectDisplay(uint16_t length)
     mDisplay = read64();
     mWriter.selectDisplay(mDisplay);
 
+    mDisplayData = nullptr;
+    mLayerBuffers = nullptr;
+
     return true;
 }
 
@@ -628,6 +648,7 @@ bool ComposerClient::CommandReader::parseSelectLayer(uint16_t length)
     }
 
     mLayer = read64();
+    mLayerBuffers = nullptr;
 
     return true;
 }
@@ -728,20 +749,13 @@ bool ComposerClient::CommandReader::parseValidateDisplay(uint16_t length)
         return false;
     }
 
-    std::vector<Layer> changedLayers;
-    std::vector<IComposerClient::Composition> compositionTypes;
     uint32_t displayRequestMask = 0x0;
-    std::vector<Layer> requestedLayers;
-    std::vector<uint32_t> requestMasks;
-
-    auto err = mHal.validateDisplay(mDisplay, &changedLayers,
-            &compositionTypes, &displayRequestMask,
-            &requestedLayers, &requestMasks);
+    auto err = validateDisplay(&displayRequestMask);
     if (err == Error::NONE) {
-        mWriter.setChangedCompositionTypes(changedLayers,
-                compositionTypes);
+        mWriter.setChangedCompositionTypes(mChangedLayers,
+                mCompositionTypes);
         mWriter.setDisplayRequests(displayRequestMask,
-                requestedLayers, requestMasks);
+                mRequestedLayers, mRequestMasks);
     } else {
         mWriter.setError(getCommandLoc(), err);
     }
@@ -757,32 +771,23 @@ bool ComposerClient::CommandReader::parsePresentOrValidateDisplay(uint16_t lengt
 
     // First try to Present as is.
     int presentFence = -1;
-    std::vector<Layer> layers;
-    std::vector<int> fences;
-    auto err = mHal.presentDisplay(mDisplay, &presentFence, &layers, &fences);
+    auto err = presentDisplay(&presentFence);
     if (err == Error::NONE) {
         mWriter.setPresentOrValidateResult(1);
         mWriter.setPresentFence(presentFence);
-        mWriter.setReleaseFences(layers, fences);
+        mWriter.setReleaseFences(mReleasedLayers, mReleaseFences);
         return true;
     }
 
     // Present has failed. We need to fallback to validate
-    std::vector<Layer> changedLayers;
-    std::vector<IComposerClient::Composition> compositionTypes;
     uint32_t displayRequestMask = 0x0;
-    std::vector<Layer> requestedLayers;
-    std::vector<uint32_t> requestMasks;
-
-    err = mHal.validateDisplay(mDisplay, &changedLayers,
-                               &compositionTypes, &displayRequestMask,
-                               &requestedLayers, &requestMasks);
+    err = validateDisplay(&displayRequestMask);
     if (err == Error::NONE) {
         mWriter.setPresentOrValidateResult(0);
-        mWriter.setChangedCompositionTypes(changedLayers,
-                                           compositionTypes);
+        mWriter.setChangedCompositionTypes(mChangedLayers,
+                                           mCompositionTypes);
         mWriter.setDisplayRequests(displayRequestMask,
-                                   requestedLayers, requestMasks);
+                                   mRequestedLayers, mRequestMasks);
     } else {
         mWriter.setError(getCommandLoc(), err);
     }
@@ -811,12 +816,10 @@ bool ComposerClient::CommandReader::parsePresentDisplay(uint16_t length)
     }
 
     int presentFence = -1;
-    std::vector<Layer> layers;
-    std::vector<int> fences;
-    auto err = mHal.presentDisplay(mDisplay, &presentFence, &layers, &fences);
+    auto err = presentDisplay(&presentFence);
     if (err == Error::NONE) {
         mWriter.setPresentFence(presentFence);
-        mWriter.setReleaseFences(layers, fences);
+        mWriter.setReleaseFences(mReleasedLayers, mReleaseFences);
     } else {
         mWriter.setError(getCommandLoc(), err);
     }
@@ -1054,6 +1057,30 @@ bool ComposerClient::CommandReader::parseSetLayerZOrder(uint16_t length)
     return true;
 }
 
+Error ComposerClient::CommandReader::validateDisplay(
+        uint32_t* outDisplayRequestMask)
+{
+    // clear() keeps the capacity, the vectors do not need to be reallocated
+    // unless the number of layers grows
+    mChangedLayers.clear();
+    mCompositionTypes.clear();
+    mRequestedLayers.clear();
+    mRequestMasks.clear();
+
+    return mHal.validateDisplay(mDisplay, &mChangedLayers,
+            &mCompositionTypes, outDisplayRequestMask,
+            &mRequestedLayers, &mRequestMasks);
+}
+
+Error ComposerClient::CommandReader::presentDisplay(int32_t* outPresentFence)
+{
+    mReleasedLayers.clear();
+    mReleaseFences.clear();
+
+    return mHal.presentDisplay(mDisplay, outPresentFence,
+            &mReleasedLayers, &mReleaseFences);
+}
+
 hwc_rect_t ComposerClient::CommandReader::readRect()
 {
     return hwc_rect_t{
@@ -1086,45 +1113,69 @@ hwc_frect_t ComposerClient::CommandReader::readFRect()
     };
 }
 
+ComposerClient::DisplayData* ComposerClient::CommandReader::getDisplayData()
+{
+    if (!mDisplayData) {
+        mDisplayData = mClient.findDisplayData(mDisplay);
+    }
+
+    return mDisplayData.get();
+}
+
+ComposerClient::LayerBuffers*
+ComposerClient::CommandReader::getLayerBuffersLocked()
+{
+    if (!mLayerBuffers ||
+            mLayerBuffersGeneration != mDisplayData->LayersGeneration) {
+        auto ly = mDisplayData->Layers.find(mLayer);
+        if (ly == mDisplayData->Layers.end()) {
+            mLayerBuffers = nullptr;
+            return nullptr;
+        }
+
+        mLayerBuffers = &ly->second;
+        mLayerBuffersGeneration = mDisplayData->LayersGeneration;
+    }
+
+    return mLayerBuffers;
+}
+
 Error ComposerClient::CommandReader::lookupBufferCacheEntryLocked(
         BufferCache cache, uint32_t slot, BufferCacheEntry** outEntry)
 {
-    auto dpy = mClient.mDisplayData.find(mDisplay);
-    if (dpy == mClient.mDisplayData.end()) {
-        return Error::BAD_DISPLAY;
-    }
+    DisplayData& dpy = *mDisplayData;
 
     BufferCacheEntry* entry = nullptr;
     switch (cache) {
     case BufferCache::CLIENT_TARGETS:
-        if (slot < dpy->second.ClientTargets.size()) {
-            entry = &dpy->second.ClientTargets[slot];
+        if (slot < dpy.ClientTargets.size()) {
+            entry = &dpy.ClientTargets[slot];
         }
         break;
     case BufferCache::OUTPUT_BUFFERS:
-        if (slot < dpy->second.OutputBuffers.size()) {
-            entry = &dpy->second.OutputBuffers[slot];
+        if (slot < dpy.OutputBuffers.size()) {
+            entry = &dpy.OutputBuffers[slot];
         }
         break;
     case BufferCache::LAYER_BUFFERS:
         {
-            auto ly = dpy->second.Layers.find(mLayer);
-            if (ly == dpy->second.Layers.end()) {
+            auto ly = getLayerBuffersLocked();
+            if (!ly) {
                 return Error::BAD_LAYER;
             }
-            if (slot < ly->second.Buffers.size()) {
-                entry = &ly->second.Buffers[slot];
+            if (slot < ly->Buffers.size()) {
+                entry = &ly->Buffers[slot];
             }
         }
         break;
     case BufferCache::LAYER_SIDEBAND_STREAMS:
         {
-            auto ly = dpy->second.Layers.find(mLayer);
-            if (ly == dpy->second.Layers.end()) {
+            auto ly = getLayerBuffersLocked();
+            if (!ly) {
                 return Error::BAD_LAYER;
             }
             if (slot == 0) {
-                entry = &ly->second.SidebandStream;
+                entry = &ly->SidebandStream;
             }
         }
         break;
@@ -1147,7 +1198,12 @@ Error ComposerClient::CommandReader::lookupBuffer(BufferCache cache,
         buffer_handle_t* outHandle)
 {
     if (useCache) {
-        std::lock_guard<std::mutex> lock(mClient.mDisplayDataMutex);
+        DisplayData* dpy = getDisplayData();
+        if (!dpy) {
+            return Error::BAD_DISPLAY;
+        }
+
+        std::lock_guard<std::mutex> lock(dpy->Mutex);
 
         BufferCacheEntry* entry;
         Error error = lookupBufferCacheEntryLocked(cache, slot, &entry);
@@ -1183,7 +1239,12 @@ Error ComposerClient::CommandReader::updateBuffer(BufferCache cache,
         return Error::NONE;
     }
 
-    std::lock_guard<std::mutex> lock(mClient.mDisplayDataMutex);
+    DisplayData* dpy = getDisplayData();
+    if (!dpy) {
+        return Error::BAD_DISPLAY;
+    }
+
+    std::lock_guard<std::mutex> lock(dpy->Mutex);
 
     BufferCacheEntry* entry = nullptr;
     Error error = lookupBufferCacheEntryLocked(cache, slot, &entry);
@@ -17,6 +17,7 @@
 #ifndef ANDROID_HARDWARE_GRAPHICS_COMPOSER_V2_1_COMPOSER_CLIENT_H
 #define ANDROID_HARDWARE_GRAPHICS_COMPOSER_V2_1_COMPOSER_CLIENT_H
 
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
@@ -115,16 +116,25 @@ protected:
     };
 
     struct DisplayData {
-        bool IsVirtual;
+        const bool IsVirtual;
+
+        // protects everything below; each display has its own lock so that
+        // commands for one display never wait on changes to another one
+        std::mutex Mutex;
 
         std::vector<BufferCacheEntry> ClientTargets;
         std::vector<BufferCacheEntry> OutputBuffers;
 
         std::unordered_map<Layer, LayerBuffers> Layers;
+        // incremented whenever a layer is erased, which invalidates pointers
+        // to LayerBuffers
+        uint32_t LayersGeneration;
 
-        DisplayData(bool isVirtual) : IsVirtual(isVirtual) {}
+        DisplayData(bool isVirtual) : IsVirtual(isVirtual), LayersGeneration(0) {}
     };
 
+    std::shared_ptr<DisplayData> findDisplayData(Display display);
+
     class CommandReader : public CommandReaderBase {
     public:
         CommandReader(ComposerClient& client);
@@ -160,6 +170,9 @@ protected:
         bool parseSetLayerVisibleRegion(uint16_t length);
         bool parseSetLayerZOrder(uint16_t length);
 
+        Error validateDisplay(uint32_t* outDisplayRequestMask);
+        Error presentDisplay(int32_t* outPresentFence);
+
         hwc_rect_t readRect();
         std::vector<hwc_rect_t> readRegion(size_t count);
         hwc_frect_t readFRect();
@@ -170,6 +183,8 @@ protected:
             LAYER_BUFFERS,
             LAYER_SIDEBAND_STREAMS,
         };
+        DisplayData* getDisplayData();
+        LayerBuffers* getLayerBuffersLocked();
         Error lookupBufferCacheEntryLocked(BufferCache cache, uint32_t slot,
                 BufferCacheEntry** outEntry);
         Error lookupBuffer(BufferCache cache, uint32_t slot,
@@ -196,6 +211,21 @@ protected:
 
         Display mDisplay;
         Layer mLayer;
+
+        // data of the selected display and layer, looked up on first use
+        // rather than for every buffer command
+        std::shared_ptr<DisplayData> mDisplayData;
+        LayerBuffers* mLayerBuffers;
+        uint32_t mLayerBuffersGeneration;
+
+        // results of validateDisplay and presentDisplay, reused by all
+        // displays since commands are executed one at a time
+        std::vector<Layer> mChangedLayers;
+        std::vector<IComposerClient::Composition> mCompositionTypes;
+        std::vector<Layer> mRequestedLayers;
+        std::vector<uint32_t> mRequestMasks;
+        std::vector<Layer> mReleasedLayers;
+        std::vector<int32_t> mReleaseFences;
     };
 
     virtual std::unique_ptr<CommandReader> createCommandReader();
@@ -211,8 +241,9 @@ protected:
 
     sp<IComposerCallback> mCallback;
 
+    // protects mDisplayData itself, but not the DisplayData in it
     std::mutex mDisplayDataMutex;
-    std::unordered_map<Display, DisplayData> mDisplayData;
+    std::unordered_map<Display, std::shared_ptr<DisplayData>> mDisplayData;
 };
 
 } // namespace implementation
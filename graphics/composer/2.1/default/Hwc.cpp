@@ -19,7 +19,9 @@
 #include "Hwc.h"
 
 #include <chrono>
+#include <inttypes.h>
 #include <type_traits>
+#include <android-base/stringprintf.h>
 #include <log/log.h>
 
 #include "ComposerClient.h"
@@ -37,7 +39,9 @@ namespace implementation {
 
 
 HwcHal::HwcHal(const hw_module_t* module)
-    : mDevice(nullptr), mDispatch(), mAdapter()
+    : mDevice(nullptr), mDispatch(), mValidateCount(0),
+      mValidateWithoutChangesCount(0), mPresentCount(0),
+      mPresentWithoutValidateCount(0), mAdapter()
 {
     // Determine what kind of module is available (HWC2 vs HWC1.X).
     hw_device_t* device = nullptr;
@@ -205,11 +209,18 @@ Return<void> HwcHal::dumpDebugInfo(dumpDebugInfo_cb hidl_cb)
 
     std::vector<char> buf(len + 1);
     mDispatch.dump(mDevice, &len, buf.data());
-    buf.resize(len + 1);
-    buf[len] = '\0';
+    buf.resize(len);
+
+    std::string stats = base::StringPrintf("\nComposer HAL statistics:\n"
+            "  validateDisplay: %" PRIu64 " (%" PRIu64 " without changes)\n"
+            "  presentDisplay: %" PRIu64 " (%" PRIu64 " without validateDisplay)\n",
+            mValidateCount.load(), mValidateWithoutChangesCount.load(),
+            mPresentCount.load(), mPresentWithoutValidateCount.load());
+    buf.insert(buf.end(), stats.begin(), stats.end());
+    buf.push_back('\0');
 
     hidl_string buf_reply;
-    buf_reply.setToExternal(buf.data(), len);
+    buf_reply.setToExternal(buf.data(), buf.size() - 1);
     hidl_cb(buf_reply);
 
     return Void();
@@ -553,40 +564,49 @@ Error HwcHal::validateDisplay(Display display,
         return static_cast<Error>(err);
     }
 
-    err = mDispatch.getChangedCompositionTypes(mDevice, display,
-            &types_count, nullptr, nullptr);
-    if (err != HWC2_ERROR_NONE) {
-        return static_cast<Error>(err);
+    mValidateCount++;
+    if (types_count == 0 && reqs_count == 0) {
+        mValidateWithoutChangesCount++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mValidatedDisplaysMutex);
+        mValidatedDisplays.insert(display);
     }
 
+    // validateDisplay already returned the numbers of changed composition
+    // types and layer requests, so there is no need to query them again, and
+    // the changed composition types are only queried when there are some
     outChangedLayers->resize(types_count);
     outCompositionTypes->resize(types_count);
-    err = mDispatch.getChangedCompositionTypes(mDevice, display,
-            &types_count, outChangedLayers->data(),
-            reinterpret_cast<
-            std::underlying_type<IComposerClient::Composition>::type*>(
-                outCompositionTypes->data()));
-    if (err != HWC2_ERROR_NONE) {
-        outChangedLayers->clear();
-        outCompositionTypes->clear();
-        return static_cast<Error>(err);
-    }
+    if (types_count > 0) {
+        err = mDispatch.getChangedCompositionTypes(mDevice, display,
+                &types_count, outChangedLayers->data(),
+                reinterpret_cast<
+                std::underlying_type<IComposerClient::Composition>::type*>(
+                    outCompositionTypes->data()));
+        if (err != HWC2_ERROR_NONE) {
+            outChangedLayers->clear();
+            outCompositionTypes->clear();
+            return static_cast<Error>(err);
+        }
 
-    int32_t display_reqs = 0;
-    err = mDispatch.getDisplayRequests(mDevice, display, &display_reqs,
-            &reqs_count, nullptr, nullptr);
-    if (err != HWC2_ERROR_NONE) {
-        outChangedLayers->clear();
-        outCompositionTypes->clear();
-        return static_cast<Error>(err);
+        outChangedLayers->resize(types_count);
+        outCompositionTypes->resize(types_count);
     }
 
+    // the display request mask is needed even when no layer has requests
+    int32_t display_reqs = 0;
     outRequestedLayers->resize(reqs_count);
     outRequestMasks->resize(reqs_count);
     err = mDispatch.getDisplayRequests(mDevice, display, &display_reqs,
-            &reqs_count, outRequestedLayers->data(),
-            reinterpret_cast<int32_t*>(outRequestMasks->data()));
-    if (err != HWC2_ERROR_NONE) {
+            &reqs_count,
+            (reqs_count > 0) ? outRequestedLayers->data() : nullptr,
+            (reqs_count > 0) ?
+                reinterpret_cast<int32_t*>(outRequestMasks->data()) : nullptr);
+    if (err == HWC2_ERROR_NONE) {
+        outRequestedLayers->resize(reqs_count);
+        outRequestMasks->resize(reqs_count);
+    } else {
         outChangedLayers->clear();
         outCompositionTypes->clear();
 
@@ -615,6 +635,14 @@ Error HwcHal::presentDisplay(Display display, int32_t* outPresentFence,
         return static_cast<Error>(err);
     }
 
+    mPresentCount++;
+    {
+        std::lock_guard<std::mutex> lock(mValidatedDisplaysMutex);
+        if (mValidatedDisplays.erase(display) == 0) {
+            mPresentWithoutValidateCount++;
+        }
+    }
+
     uint32_t count = 0;
     err = mDispatch.getReleaseFences(mDevice, display, &count,
             nullptr, nullptr);
@@ -17,6 +17,7 @@
 #ifndef ANDROID_HARDWARE_GRAPHICS_COMPOSER_V2_1_HWC_H
 #define ANDROID_HARDWARE_GRAPHICS_COMPOSER_V2_1_HWC_H
 
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
@@ -211,6 +212,16 @@ private:
         HWC2_PFN_VALIDATE_DISPLAY validateDisplay;
     } mDispatch;
 
+    // frame statistics reported by dumpDebugInfo
+    std::atomic<uint64_t> mValidateCount;
+    std::atomic<uint64_t> mValidateWithoutChangesCount;
+    std::atomic<uint64_t> mPresentCount;
+    std::atomic<uint64_t> mPresentWithoutValidateCount;
+
+    // displays validated since their last presentDisplay
+    std::mutex mValidatedDisplaysMutex;
+    std::unordered_set<Display> mValidatedDisplays;
+
     std::mutex mClientMutex;
     std::condition_variable mClientDestroyedWait;
     wp<ComposerClient> mClient;
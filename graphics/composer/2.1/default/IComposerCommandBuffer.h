@@ -64,6 +64,10 @@ public:
     virtual ~CommandWriterBase()
     {
         reset();
+
+        for (auto handle : mFreeFenceHandles) {
+            native_handle_delete(handle);
+        }
     }
 
     void reset()
@@ -74,10 +78,15 @@ public:
         // handles in mDataHandles are owned by the caller
         mDataHandles.clear();
 
-        // handles in mTemporaryHandles are owned by the writer
+        // handles in mTemporaryHandles are owned by the writer; fence handles
+        // are kept for the next batch of commands
         for (auto handle : mTemporaryHandles) {
             native_handle_close(handle);
-            native_handle_delete(handle);
+            if (handle->numFds == 1 && handle->numInts == 0) {
+                mFreeFenceHandles.push_back(handle);
+            } else {
+                native_handle_delete(handle);
+            }
         }
         mTemporaryHandles.clear();
     }
@@ -109,18 +118,25 @@ public:
             }
         }
 
-        // write data to queue, optionally resizing it
-        if (mQueue && (mDataMaxSize <= mQueue->getQuantumCount())) {
-            if (!mQueue->write(mData.get(), mDataWritten)) {
+        // write data to queue, optionally resizing it; the queue is only
+        // replaced when the data do not fit, and it grows at least twice as
+        // large so that the reader does not have to remap it every few frames
+        if (mQueue && (mDataWritten <= mQueue->getQuantumCount())) {
+            if (!writeToQueue(mQueue.get())) {
                 ALOGE("failed to write commands to message queue");
                 return false;
             }
 
             *outQueueChanged = false;
         } else {
-            auto newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
-            if (!newQueue->isValid() ||
-                    !newQueue->write(mData.get(), mDataWritten)) {
+            size_t newQueueSize = mDataMaxSize;
+            if (mQueue) {
+                newQueueSize = std::max(newQueueSize,
+                        mQueue->getQuantumCount() * 2);
+            }
+
+            auto newQueue = std::make_unique<CommandQueueType>(newQueueSize);
+            if (!newQueue->isValid() || !writeToQueue(newQueue.get())) {
                 ALOGE("failed to prepare a new message queue ");
                 return false;
             }
@@ -602,7 +618,13 @@ protected:
 
     native_handle_t* getTemporaryHandle(int numFds, int numInts)
     {
-        native_handle_t* handle = native_handle_create(numFds, numInts);
+        native_handle_t* handle;
+        if (numFds == 1 && numInts == 0 && !mFreeFenceHandles.empty()) {
+            handle = mFreeFenceHandles.back();
+            mFreeFenceHandles.pop_back();
+        } else {
+            handle = native_handle_create(numFds, numInts);
+        }
         if (handle) {
             mTemporaryHandles.push_back(handle);
         }
@@ -613,6 +635,25 @@ protected:
         std::numeric_limits<uint16_t>::max();
 
 private:
+    // copy the data directly into the (possibly wrapped) queue memory
+    bool writeToQueue(CommandQueueType* queue)
+    {
+        CommandQueueType::MemTransaction tx;
+        if (!queue->beginWrite(mDataWritten, &tx)) {
+            return false;
+        }
+
+        const auto& first = tx.getFirstRegion();
+        const auto& second = tx.getSecondRegion();
+        size_t firstLength = std::min(first.getLength(),
+                static_cast<size_t>(mDataWritten));
+        std::copy_n(mData.get(), firstLength, first.getAddress());
+        std::copy_n(mData.get() + firstLength, mDataWritten - firstLength,
+                second.getAddress());
+
+        return queue->commitWrite(mDataWritten);
+    }
+
     void growData(uint32_t grow)
     {
         uint32_t newWritten = mDataWritten + grow;
@@ -645,6 +686,8 @@ private:
 
     std::vector<hidl_handle> mDataHandles;
     std::vector<native_handle_t *> mTemporaryHandles;
+    // closed fence handles to be reused by getTemporaryHandle
+    std::vector<native_handle_t *> mFreeFenceHandles;
 
     std::unique_ptr<CommandQueueType> mQueue;
 };
@@ -682,6 +725,8 @@ public:
             mData = std::make_unique<uint32_t[]>(mDataMaxSize);
         }
 
+        // The commands are copied out of the queue before parsing, so that a
+        // misbehaving writer cannot change them after they were validated.
         if (commandLength > mDataMaxSize ||
                 !mQueue->read(mData.get(), commandLength)) {
             ALOGE("failed to read commands from message queue");
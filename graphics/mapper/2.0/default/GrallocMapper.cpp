@@ -20,9 +20,13 @@
 #include "Gralloc0Mapper.h"
 #include "Gralloc1Mapper.h"
 #include "GrallocBufferDescriptor.h"
+#include "RegisteredHandlePool.h"
 
 #include <inttypes.h>
 
+#include <new>
+#include <type_traits>
+
 #include <log/log.h>
 #include <sync/sync.h>
 
@@ -38,41 +42,18 @@ using android::hardware::graphics::common::V1_0::PixelFormat;
 
 namespace {
 
-class RegisteredHandlePool {
-   public:
-    bool add(buffer_handle_t bufferHandle) {
-        std::lock_guard<std::mutex> lock(mMutex);
-        return mHandles.insert(bufferHandle).second;
-    }
-
-    native_handle_t* pop(void* buffer) {
-        auto bufferHandle = static_cast<native_handle_t*>(buffer);
-
-        std::lock_guard<std::mutex> lock(mMutex);
-        return mHandles.erase(bufferHandle) == 1 ? bufferHandle : nullptr;
-    }
-
-    buffer_handle_t get(const void* buffer) {
-        auto bufferHandle = static_cast<buffer_handle_t>(buffer);
-
-        std::lock_guard<std::mutex> lock(mMutex);
-        return mHandles.count(bufferHandle) == 1 ? bufferHandle : nullptr;
-    }
-
-   private:
-    std::mutex mMutex;
-    std::unordered_set<buffer_handle_t> mHandles;
-};
-
 // GraphicBufferMapper is expected to be valid (and leaked) during process
 // termination.  We need to make sure IMapper, and in turn, gRegisteredHandles
-// are valid as well.  Create the registered handle pool on the heap, and let
-// it leak for simplicity.
+// are valid as well.  Construct the registered handle pool in static storage,
+// which keeps the cache line alignment of the shards, and never destroy it.
 //
 // However, there is no way to make sure gralloc0/gralloc1 are valid.  Any use
 // of static/global object in gralloc0/gralloc1 that may have been destructed
 // is potentially broken.
-RegisteredHandlePool* gRegisteredHandles = new RegisteredHandlePool;
+std::aligned_storage<sizeof(RegisteredHandlePool),
+                     alignof(RegisteredHandlePool)>::type gRegisteredHandlesStorage;
+RegisteredHandlePool* gRegisteredHandles =
+    new (&gRegisteredHandlesStorage) RegisteredHandlePool;
 
 }  // anonymous namespace
 
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GRAPHICS_MAPPER_V2_0_REGISTEREDHANDLEPOOL_H
+#define ANDROID_HARDWARE_GRAPHICS_MAPPER_V2_0_REGISTEREDHANDLEPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_set>
+
+#include <cutils/native_handle.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace mapper {
+namespace V2_0 {
+namespace implementation {
+
+// Registered handles are spread over shards, each with its own lock, so that
+// threads locking and unlocking different buffers rarely contend.
+class RegisteredHandlePool {
+   public:
+    bool add(buffer_handle_t bufferHandle) {
+        Shard& shard = getShard(bufferHandle);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.handles.insert(bufferHandle).second;
+    }
+
+    native_handle_t* pop(void* buffer) {
+        auto bufferHandle = static_cast<native_handle_t*>(buffer);
+
+        Shard& shard = getShard(bufferHandle);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.handles.erase(bufferHandle) == 1 ? bufferHandle : nullptr;
+    }
+
+    buffer_handle_t get(const void* buffer) {
+        auto bufferHandle = static_cast<buffer_handle_t>(buffer);
+
+        Shard& shard = getShard(bufferHandle);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.handles.count(bufferHandle) == 1 ? bufferHandle : nullptr;
+    }
+
+   private:
+    static constexpr size_t kShardCount = 16;
+
+    // padded to a cache line to avoid false sharing between shards
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_set<buffer_handle_t> handles;
+    };
+
+    Shard& getShard(const void* bufferHandle) {
+        // handles are heap allocated, so the low bits carry little entropy
+        uintptr_t key = reinterpret_cast<uintptr_t>(bufferHandle);
+        key ^= key >> 12;
+        return mShards[(key >> 4) % kShardCount];
+    }
+
+    Shard mShards[kShardCount];
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace mapper
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_GRAPHICS_MAPPER_V2_0_REGISTEREDHANDLEPOOL_H
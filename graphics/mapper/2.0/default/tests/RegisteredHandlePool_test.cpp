@@ -0,0 +1,168 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "RegisteredHandlePool.h"
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace mapper {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+// The pool as it was before sharding: one set behind one lock
+class SingleLockHandlePool {
+   public:
+    bool add(buffer_handle_t bufferHandle) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mHandles.insert(bufferHandle).second;
+    }
+
+    native_handle_t* pop(void* buffer) {
+        auto bufferHandle = static_cast<native_handle_t*>(buffer);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mHandles.erase(bufferHandle) == 1 ? bufferHandle : nullptr;
+    }
+
+    buffer_handle_t get(const void* buffer) {
+        auto bufferHandle = static_cast<buffer_handle_t>(buffer);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mHandles.count(bufferHandle) == 1 ? bufferHandle : nullptr;
+    }
+
+   private:
+    std::mutex mMutex;
+    std::unordered_set<buffer_handle_t> mHandles;
+};
+
+class RegisteredHandlePoolTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        for (int i = 0; i < kThreads * kHandlesPerThread; i++) {
+            mHandles.push_back(native_handle_create(0, 0));
+        }
+    }
+
+    void TearDown() override {
+        for (auto handle : mHandles) {
+            native_handle_delete(handle);
+        }
+    }
+
+    // Registers, looks up and unregisters the handles of each thread many times over, and
+    // returns the number of unexpected results
+    template <typename Pool>
+    int runThreads(Pool& pool, int rounds, int64_t* nanos) {
+        std::atomic<int> errors(0);
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < kThreads; t++) {
+            threads.emplace_back([&, t] {
+                auto first = mHandles.begin() + t * kHandlesPerThread;
+                auto last = first + kHandlesPerThread;
+                for (int r = 0; r < rounds; r++) {
+                    for (auto it = first; it != last; ++it) {
+                        errors += !pool.add(*it);
+                    }
+                    for (auto it = first; it != last; ++it) {
+                        errors += pool.get(*it) != *it;
+                        errors += pool.add(*it);
+                    }
+                    for (auto it = first; it != last; ++it) {
+                        errors += pool.pop(*it) != *it;
+                        errors += pool.get(*it) != nullptr;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        *nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+        return errors;
+    }
+
+    static constexpr int kThreads = 4;
+    static constexpr int kHandlesPerThread = 64;
+
+    std::vector<native_handle_t*> mHandles;
+};
+
+TEST_F(RegisteredHandlePoolTest, addGetPop) {
+    RegisteredHandlePool pool;
+    for (auto handle : mHandles) {
+        ASSERT_EQ(nullptr, pool.get(handle));
+        ASSERT_TRUE(pool.add(handle));
+        ASSERT_FALSE(pool.add(handle));
+    }
+    for (auto handle : mHandles) {
+        ASSERT_EQ(handle, pool.get(handle));
+    }
+    for (auto handle : mHandles) {
+        ASSERT_EQ(handle, pool.pop(handle));
+        ASSERT_EQ(nullptr, pool.pop(handle));
+        ASSERT_EQ(nullptr, pool.get(handle));
+    }
+}
+
+TEST_F(RegisteredHandlePoolTest, concurrentThreads) {
+    RegisteredHandlePool pool;
+    int64_t nanos;
+    ASSERT_EQ(0, runThreads(pool, 200, &nanos));
+    for (auto handle : mHandles) {
+        ASSERT_EQ(nullptr, pool.get(handle));
+    }
+}
+
+TEST_F(RegisteredHandlePoolTest, concurrentThreadsBenchmark) {
+    const int kRounds = 2000;
+    RegisteredHandlePool shardedPool;
+    SingleLockHandlePool singleLockPool;
+    int64_t shardedNanos, singleLockNanos;
+    ASSERT_EQ(0, runThreads(shardedPool, kRounds, &shardedNanos));
+    ASSERT_EQ(0, runThreads(singleLockPool, kRounds, &singleLockNanos));
+
+    // Each round does 5 operations per handle
+    int64_t ops = int64_t(kRounds) * kHandlesPerThread * 5;
+    std::cout << "Handle pool, " << kThreads << " threads, per operation and thread: sharded "
+              << shardedNanos / ops << "ns, single lock " << singleLockNanos / ops << "ns"
+              << std::endl;
+}
+
+}  // anonymous namespace
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace mapper
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
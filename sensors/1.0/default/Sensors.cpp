@@ -57,6 +57,10 @@ Sensors::Sensors()
     : mInitCheck(NO_INIT),
       mSensorModule(nullptr),
       mSensorDevice(nullptr) {
+    for (auto &arena : mPollArenas) {
+        arena.buffer.reset(new sensors_event_t[kPollMaxBufferSize]);
+        arena.events.resize(kPollMaxBufferSize);
+    }
     status_t err = OK;
     if (UseMultiHal()) {
         mSensorModule = ::get_multi_hal_module_info();
@@ -162,7 +166,12 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
     hidl_vec<Event> out;
     hidl_vec<SensorInfo> dynamicSensorsAdded;
 
+    // Events are converted into the arena reserved below and passed to the callback straight
+    // from it, so the arena stays reserved until the callback returns.
+    std::unique_lock<std::mutex> arenaLock;
+    PollArena *arena = nullptr;
     std::unique_ptr<sensors_event_t[]> data;
+    hidl_vec<Event> events;
     int err = android::NO_ERROR;
 
     { // scope of reentry lock
@@ -187,10 +196,28 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
             err = android::BAD_VALUE;
         } else {
             int bufferSize = maxCount <= kPollMaxBufferSize ? maxCount : kPollMaxBufferSize;
-            data.reset(new sensors_event_t[bufferSize]);
+
+            // The previous poll() may still be running its callback out of the other arena.
+            // Never wait for it; if both arenas are busy, use buffers of this call only.
+            for (auto &candidate : mPollArenas) {
+                std::unique_lock<std::mutex> candidateLock(candidate.lock, std::try_to_lock);
+                if (candidateLock.owns_lock()) {
+                    arenaLock = std::move(candidateLock);
+                    arena = &candidate;
+                    break;
+                }
+            }
+            sensors_event_t *buffer;
+            if (arena != nullptr) {
+                buffer = arena->buffer.get();
+            } else {
+                data.reset(new sensors_event_t[bufferSize]);
+                buffer = data.get();
+            }
+
             err = mSensorDevice->poll(
                     reinterpret_cast<sensors_poll_device_t *>(mSensorDevice),
-                    data.get(), bufferSize);
+                    buffer, bufferSize);
         }
     }
 
@@ -200,32 +227,41 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
     }
 
     const size_t count = (size_t)err;
+    const sensors_event_t *src;
+    Event *dst;
+    if (arena != nullptr) {
+        src = arena->buffer.get();
+        dst = arena->events.data();
+    } else {
+        src = data.get();
+        events.resize(count);
+        dst = events.data();
+    }
 
-    for (size_t i = 0; i < count; ++i) {
-        if (data[i].type != SENSOR_TYPE_DYNAMIC_SENSOR_META) {
-            continue;
-        }
+    size_t numDynamicSensors = convertFromSensorEvents(count, src, dst);
 
-        const dynamic_sensor_meta_event_t *dyn = &data[i].dynamic_sensor_meta;
+    if (numDynamicSensors > 0) {
+        dynamicSensorsAdded.resize(numDynamicSensors);
+        size_t j = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (src[i].type != SENSOR_TYPE_DYNAMIC_SENSOR_META) {
+                continue;
+            }
 
-        if (!dyn->connected) {
-            continue;
-        }
+            const dynamic_sensor_meta_event_t *dyn = &src[i].dynamic_sensor_meta;
 
-        CHECK(dyn->sensor != nullptr);
-        CHECK_EQ(dyn->sensor->handle, dyn->handle);
+            if (!dyn->connected) {
+                continue;
+            }
 
-        SensorInfo info;
-        convertFromSensor(*dyn->sensor, &info);
+            CHECK(dyn->sensor != nullptr);
+            CHECK_EQ(dyn->sensor->handle, dyn->handle);
 
-        size_t numDynamicSensors = dynamicSensorsAdded.size();
-        dynamicSensorsAdded.resize(numDynamicSensors + 1);
-        dynamicSensorsAdded[numDynamicSensors] = info;
+            convertFromSensor(*dyn->sensor, &dynamicSensorsAdded[j++]);
+        }
     }
 
-    out.resize(count);
-    convertFromSensorEvents(err, data.get(), &out);
-
+    out.setToExternal(dst, count);
     _hidl_cb(Result::OK, out, dynamicSensorsAdded);
 
     return Void();
@@ -328,19 +364,6 @@ Return<void> Sensors::configDirectReport(
     return Void();
 }
 
-// static
-void Sensors::convertFromSensorEvents(
-        size_t count,
-        const sensors_event_t *srcArray,
-        hidl_vec<Event> *dstVec) {
-    for (size_t i = 0; i < count; ++i) {
-        const sensors_event_t &src = srcArray[i];
-        Event *dst = &(*dstVec)[i];
-
-        convertFromSensorEvent(src, dst);
-    }
-}
-
 ISensors *HIDL_FETCH_ISensors(const char * /* hal */) {
     Sensors *sensors = new Sensors;
     if (sensors->initCheck() != OK) {
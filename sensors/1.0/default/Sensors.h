@@ -21,6 +21,7 @@
 #include <android-base/macros.h>
 #include <android/hardware/sensors/1.0/ISensors.h>
 #include <hardware/sensors.h>
+#include <memory>
 #include <mutex>
 
 namespace android {
@@ -69,10 +70,17 @@ private:
     sensors_poll_device_1_t *mSensorDevice;
     std::mutex mPollLock;
 
-    int getHalDeviceVersion() const;
+    // Buffers reused by poll(). An arena is reserved by a poll() call from before the device is
+    // polled until its callback returns, while mPollLock is only held around the device poll.
+    // Two arenas let the next poll() proceed while the previous callback is still running.
+    struct PollArena {
+        std::mutex lock;
+        std::unique_ptr<sensors_event_t[]> buffer;
+        hidl_vec<Event> events;
+    };
+    PollArena mPollArenas[2];
 
-    static void convertFromSensorEvents(
-            size_t count, const sensors_event_t *src, hidl_vec<Event> *dst);
+    int getHalDeviceVersion() const;
 
     DISALLOW_COPY_AND_ASSIGN(Sensors);
 };
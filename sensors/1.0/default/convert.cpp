@@ -207,6 +207,19 @@ void convertFromSensorEvent(const sensors_event_t &src, Event *dst) {
   }
 }
 
+size_t convertFromSensorEvents(size_t count, const sensors_event_t *src, Event *dst) {
+    size_t numDynamicSensorsAdded = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (src[i].type == SENSOR_TYPE_DYNAMIC_SENSOR_META
+                && src[i].dynamic_sensor_meta.connected) {
+            ++numDynamicSensorsAdded;
+        }
+        // Resets every field of dst[i], so nothing is left from an earlier event.
+        convertFromSensorEvent(src[i], &dst[i]);
+    }
+    return numDynamicSensorsAdded;
+}
+
 void convertToSensorEvent(const Event &src, sensors_event_t *dst) {
   *dst = {
       .version = sizeof(sensors_event_t),
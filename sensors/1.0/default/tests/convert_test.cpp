@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sensors/convert.h>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr size_t kPollMaxBufferSize = 128;
+
+sensors_event_t makeEvent(int32_t type, int32_t handle, int64_t timestamp) {
+    sensors_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.version = sizeof(sensors_event_t);
+    event.sensor = handle;
+    event.type = type;
+    event.timestamp = timestamp;
+    for (size_t i = 0; i < 16; ++i) {
+        event.data[i] = 0.5f * (i + 1) + handle;
+    }
+    return event;
+}
+
+// One event of every kind of payload, in an order that puts small payloads after large ones.
+std::vector<sensors_event_t> makeCannedEvents() {
+    std::vector<sensors_event_t> events;
+    int64_t timestamp = 1000;
+
+    events.push_back(makeEvent(SENSOR_TYPE_POSE_6DOF, 1, timestamp++));
+    events.push_back(makeEvent(SENSOR_TYPE_ACCELEROMETER, 2, timestamp++));
+    events.back().acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+    events.push_back(makeEvent(SENSOR_TYPE_ROTATION_VECTOR, 3, timestamp++));
+    events.push_back(makeEvent(SENSOR_TYPE_GYROSCOPE, 4, timestamp++));
+    events.back().gyro.status = SENSOR_STATUS_ACCURACY_LOW;
+    events.push_back(makeEvent(SENSOR_TYPE_GYROSCOPE_UNCALIBRATED, 5, timestamp++));
+    events.push_back(makeEvent(SENSOR_TYPE_LIGHT, 6, timestamp++));
+    events.push_back(makeEvent(SENSOR_TYPE_STEP_COUNTER, 7, timestamp++));
+    events.back().u64.step_counter = 12345;
+    events.push_back(makeEvent(SENSOR_TYPE_HEART_RATE, 8, timestamp++));
+    events.back().heart_rate.bpm = 72;
+    events.back().heart_rate.status = SENSOR_STATUS_ACCURACY_MEDIUM;
+    events.push_back(makeEvent(SENSOR_TYPE_MAGNETIC_FIELD, 9, timestamp++));
+    events.push_back(makeEvent(SENSOR_TYPE_META_DATA, 0, timestamp++));
+    events.back().meta_data.what = META_DATA_FLUSH_COMPLETE;
+    events.back().meta_data.sensor = 9;
+    events.push_back(makeEvent(SENSOR_TYPE_DYNAMIC_SENSOR_META, 10, timestamp++));
+    events.back().dynamic_sensor_meta.connected = 1;
+    events.back().dynamic_sensor_meta.handle = 42;
+    events.push_back(makeEvent(SENSOR_TYPE_DYNAMIC_SENSOR_META, 10, timestamp++));
+    events.back().dynamic_sensor_meta.connected = 0;
+    events.back().dynamic_sensor_meta.handle = 43;
+    events.push_back(makeEvent(SENSOR_TYPE_ADDITIONAL_INFO, 11, timestamp++));
+    events.back().additional_info.type = AINFO_BEGIN;
+    events.back().additional_info.serial = 3;
+    events.push_back(makeEvent(SENSOR_TYPE_GRAVITY, 12, timestamp++));
+    events.push_back(makeEvent(SENSOR_TYPE_LINEAR_ACCELERATION, 13, timestamp++));
+    events.push_back(makeEvent(SENSOR_TYPE_DEVICE_PRIVATE_BASE + 1, 14, timestamp++));
+    return events;
+}
+
+void expectSameEvent(const Event& expected, const Event& actual, size_t index) {
+    EXPECT_EQ(expected.sensorHandle, actual.sensorHandle) << "event " << index;
+    EXPECT_EQ(expected.sensorType, actual.sensorType) << "event " << index;
+    EXPECT_EQ(expected.timestamp, actual.timestamp) << "event " << index;
+    // Compare the raw payload, so that bytes left over from an earlier event are caught too.
+    EXPECT_EQ(0, memcmp(&expected.u, &actual.u, sizeof(expected.u))) << "event " << index;
+}
+
+// Stub of a HAL device that returns the canned events from every poll().
+struct StubPollDevice {
+    sensors_poll_device_1_t device;
+    std::vector<sensors_event_t> events;
+
+    StubPollDevice() : events(makeCannedEvents()) {
+        memset(&device, 0, sizeof(device));
+        device.poll = &StubPollDevice::poll;
+        while (events.size() < kPollMaxBufferSize) {
+            sensors_event_t event = makeEvent(SENSOR_TYPE_ACCELEROMETER, 2, events.size());
+            events.push_back(event);
+        }
+    }
+
+    static int poll(sensors_poll_device_t *dev, sensors_event_t *data, int count) {
+        auto self = reinterpret_cast<StubPollDevice *>(dev);
+        int n = std::min(count, static_cast<int>(self->events.size()));
+        memcpy(data, self->events.data(), n * sizeof(sensors_event_t));
+        return n;
+    }
+};
+
+}  // namespace
+
+TEST(SensorsConvertTest, convertFromSensorEvents_MatchesSingleEventConversion) {
+    std::vector<sensors_event_t> src = makeCannedEvents();
+
+    std::vector<Event> expected(src.size());
+    for (size_t i = 0; i < src.size(); ++i) {
+        memset(&expected[i], 0, sizeof(Event));
+        convertFromSensorEvent(src[i], &expected[i]);
+    }
+
+    std::vector<Event> actual(src.size());
+    ASSERT_EQ(1u, convertFromSensorEvents(src.size(), src.data(), actual.data()));
+    for (size_t i = 0; i < src.size(); ++i) {
+        expectSameEvent(expected[i], actual[i], i);
+    }
+}
+
+TEST(SensorsConvertTest, convertFromSensorEvents_ReusedBufferIsReset) {
+    std::vector<sensors_event_t> src = makeCannedEvents();
+
+    std::vector<Event> expected(src.size());
+    for (size_t i = 0; i < src.size(); ++i) {
+        memset(&expected[i], 0, sizeof(Event));
+        convertFromSensorEvent(src[i], &expected[i]);
+    }
+
+    // Simulate a buffer that holds other events from an earlier poll.
+    std::vector<Event> reused(src.size());
+    memset(reused.data(), 0xa5, reused.size() * sizeof(Event));
+    std::vector<sensors_event_t> reversed(src.rbegin(), src.rend());
+    convertFromSensorEvents(reversed.size(), reversed.data(), reused.data());
+
+    convertFromSensorEvents(src.size(), src.data(), reused.data());
+    for (size_t i = 0; i < src.size(); ++i) {
+        expectSameEvent(expected[i], reused[i], i);
+    }
+}
+
+TEST(SensorsConvertTest, convertFromSensorEvents_Benchmark) {
+    // Compares the per poll() allocations done before with the buffers now reused by the
+    // service, for full polls of a stub device.
+    constexpr int kPolls = 20000;
+    StubPollDevice stub;
+    auto dev = reinterpret_cast<sensors_poll_device_t *>(&stub.device);
+
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kPolls; ++i) {
+        std::unique_ptr<sensors_event_t[]> data(new sensors_event_t[kPollMaxBufferSize]);
+        int n = stub.device.poll(dev, data.get(), kPollMaxBufferSize);
+        hidl_vec<Event> out;
+        out.resize(n);
+        for (int j = 0; j < n; ++j) {
+            convertFromSensorEvent(data[j], &out[j]);
+        }
+        total += out.size();
+    }
+    auto allocatingNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count() / kPolls;
+
+    std::unique_ptr<sensors_event_t[]> buffer(new sensors_event_t[kPollMaxBufferSize]);
+    hidl_vec<Event> events;
+    events.resize(kPollMaxBufferSize);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kPolls; ++i) {
+        int n = stub.device.poll(dev, buffer.get(), kPollMaxBufferSize);
+        convertFromSensorEvents(n, buffer.get(), events.data());
+        hidl_vec<Event> out;
+        out.setToExternal(events.data(), n);
+        total += out.size();
+    }
+    auto reusingNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count() / kPolls;
+
+    ASSERT_EQ(2u * kPolls * kPollMaxBufferSize, total);
+    std::cout << "poll of " << kPollMaxBufferSize << " events: allocating "
+              << allocatingNanos << "ns, reused buffers " << reusingNanos << "ns" << std::endl;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android